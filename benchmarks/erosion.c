@@ -0,0 +1,85 @@
+// Droplet erosion, scalar kernel against the AVX2 packet kernel on one thread.
+// The packet kernel spawns, moves and writes its droplets in a different order, so the two
+// maps never match exactly. They count as equivalent when their mean height changes are
+// within MAX_RELATIVE_DIFFERENCE of each other, the exit code is 1 when they aren't.
+// Not part of the game project, build it next to the sources it times:
+//   gcc -O2 -I.. -I../glew-2.1.0-win32/glew-2.1.0/include erosion.c ../terrain.c ../noise.c ../noisegraph.c ../thread.c ../simd.c ../util.c -lm -lpthread -o erosion
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "terrain.h"
+#include "simd.h"
+#include "util.h"
+
+#define MAP_SIZE 512
+#define DROPLET_COUNT 100000
+#define EROSION_SEED 42
+#define MAX_RELATIVE_DIFFERENCE 0.05
+
+static float* createBenchmarkMap()
+{
+    Noise* noise = createNoise(EROSION_SEED, NOISE_INTEGER_HASH);
+    NoiseGraph* graph = createNoiseGraph(noise);
+    compileNoiseGraph(graph, addFbmNode(graph, 0.01f, 10));
+
+    int offset[2] = { 0, 0 };
+    float* heightMap = generateHeightMap(MAP_SIZE, MAP_SIZE, 150, graph, offset, 0);
+
+    cleanNoiseGraph(graph);
+    cleanNoise(noise);
+    return heightMap;
+}
+
+static double sumHeights(const float* heightMap)
+{
+    double sum = 0.0;
+    for (int i = 0; i < MAP_SIZE * MAP_SIZE; i++)
+        sum += heightMap[i];
+    return sum;
+}
+
+// Returns the milliseconds the erosion took and leaves the eroded map in heightMap
+static long timeErosion(float* heightMap, TerrainBrush* brush, bool useSimd)
+{
+    long start = getTime();
+    erodeHeightMapParallel(heightMap, MAP_SIZE, MAP_SIZE, brush, EROSION_SEED, DROPLET_COUNT, useSimd, NULL);
+    return getTime() - start;
+}
+
+int main()
+{
+    TerrainBrush* brush = createTerrainBrush(MAP_SIZE, MAP_SIZE);
+    float* original = createBenchmarkMap();
+    float* scalar = (float*)malloc(MAP_SIZE * MAP_SIZE * sizeof(float));
+    float* simd = (float*)malloc(MAP_SIZE * MAP_SIZE * sizeof(float));
+    memcpy(scalar, original, MAP_SIZE * MAP_SIZE * sizeof(float));
+    memcpy(simd, original, MAP_SIZE * MAP_SIZE * sizeof(float));
+
+    int result = 0;
+    double before = sumHeights(original);
+    long scalarTime = timeErosion(scalar, brush, false);
+    double scalarChange = (sumHeights(scalar) - before) / (MAP_SIZE * MAP_SIZE);
+    printf("scalar: %ld ms, mean height change %f\n", scalarTime, scalarChange);
+
+    if (!cpuHasAvx2()) {
+        printf("AVX2: not supported by this CPU\n");
+    }
+    else {
+        long simdTime = timeErosion(simd, brush, true);
+        double simdChange = (sumHeights(simd) - before) / (MAP_SIZE * MAP_SIZE);
+        printf("AVX2:   %ld ms, mean height change %f\n", simdTime, simdChange);
+
+        double difference = fabs(simdChange - scalarChange) / fabs(scalarChange);
+        result = difference <= MAX_RELATIVE_DIFFERENCE ? 0 : 1;
+        printf("relative difference %.2f%%, bound %.2f%%: %s\n", difference * 100.0, MAX_RELATIVE_DIFFERENCE * 100.0, result == 0 ? "ok" : "FAILED");
+    }
+
+    free(simd);
+    free(scalar);
+    free(original);
+    cleanTerrainBrush(brush);
+    return result;
+}
@@ -0,0 +1,74 @@
+// Per-sample cost of perlin2dTile at the octave counts we ship, next to per-sample perlin2d.
+// Not part of the game project. Build it twice, the second time with every octave count on
+// the generic tile loop, and compare the tile columns for the speedup of the specialized kernels:
+//   gcc -O2 -I.. noise.c ../noise.c ../simd.c ../util.c -lm -o noise
+//   gcc -O2 -I.. -DNOISE_GENERIC_TILES noise.c ../noise.c ../simd.c ../util.c -lm -o noise_generic
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "noise.h"
+#include "util.h"
+
+#define TILE_SIZE 512
+#define TILE_REPEATS 32
+#define SAMPLE_SIZE 512
+#define BEST_OF 7
+#define FREQUENCY 0.01f
+
+static volatile float sink;
+
+// Best of BEST_OF runs, in nanoseconds per sample
+static double timeTile(const Noise* noise, float* out, int depth)
+{
+    long best = -1;
+    for (int run = 0; run < BEST_OF; run++) {
+        long start = getTime();
+        for (int repeat = 0; repeat < TILE_REPEATS; repeat++)
+            perlin2dTile(out, TILE_SIZE, TILE_SIZE, repeat * TILE_SIZE, 0, noise, FREQUENCY, depth);
+        long elapsed = getTime() - start;
+        if (best < 0 || elapsed < best)
+            best = elapsed;
+    }
+
+    return best * 1e6 / ((double)TILE_SIZE * TILE_SIZE * TILE_REPEATS);
+}
+
+static double timeSamples(const Noise* noise, int depth)
+{
+    long best = -1;
+    for (int run = 0; run < BEST_OF; run++) {
+        long start = getTime();
+        float sum = 0.0f;
+        for (int y = 0; y < SAMPLE_SIZE; y++)
+            for (int x = 0; x < SAMPLE_SIZE; x++)
+                sum += perlin2d((float)x, (float)y, noise, FREQUENCY, depth);
+        sink = sum;
+        long elapsed = getTime() - start;
+        if (best < 0 || elapsed < best)
+            best = elapsed;
+    }
+
+    return best * 1e6 / ((double)SAMPLE_SIZE * SAMPLE_SIZE);
+}
+
+int main()
+{
+    static const int depths[] = { 4, 6, 8, 10, 12 };
+    Noise* noise = createNoise(42, NOISE_INTEGER_HASH);
+    float* out = (float*)malloc(TILE_SIZE * TILE_SIZE * sizeof(float));
+
+#ifdef NOISE_GENERIC_TILES
+    printf("tile kernels: generic loop\n");
+#else
+    printf("tile kernels: specialized\n");
+#endif
+    printf("depth   perlin2d   perlin2dTile (ns per sample)\n");
+
+    for (int i = 0; i < (int)(sizeof(depths) / sizeof(depths[0])); i++)
+        printf("%5d   %8.1f   %12.2f\n", depths[i], timeSamples(noise, depths[i]), timeTile(noise, out, depths[i]));
+
+    free(out);
+    cleanNoise(noise);
+    return 0;
+}
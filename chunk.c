@@ -0,0 +1,283 @@
+#include "chunk.h"
+
+#include <stdlib.h>
+
+#include "hydraulic.h"
+#include "thermal.h"
+
+// Erosion settings
+#define EROSION_DROPLET_COUNT 100000
+#define HYDRAULIC_ITERATIONS 300
+#define THERMAL_ITERATIONS 50
+#define EROSION_STEP_MS 10 // Droplet erosion checks for a cancel between steps this long
+
+// The finest octaves span thousands of lattice units per chunk, far past the permutation's period
+#define CHUNK_NOISE_HASH NOISE_INTEGER_HASH
+
+// Noise settings at LOD 0
+#define CHUNK_HEIGHT_AMPLIFIER 150
+#define CHUNK_FREQUENCY 0.01f
+#define CHUNK_OCTAVES 10
+
+typedef struct {
+    long id;
+    ChunkKey key;
+    int offset[2];        // First sample of the chunk, counted in samples of its LOD
+    unsigned int seed;    // Erosion seed of this chunk alone
+    ErosionEngine erosionEngine;
+    void* upload;         // Destination such as a mapped GPU buffer, NULL builds a Mesh
+    VertexFormat uploadFormat;
+} ChunkRequest;
+
+struct ChunkGenerator {
+    TerrainBrush* brush;
+    ThreadPool* pool;
+    Thread* thread;
+    Signal* wake;
+    void* volatile pendingRequest; // ChunkRequest not yet picked up by the worker
+    void* volatile readyChunk;     // Chunk finished by the worker and not yet taken
+    long lastRequest;              // Only touched by the requesting thread
+    volatile long lastCompleted;
+    volatile long quit;
+};
+
+// A newer request or shutting down abandons the chunk being generated
+static bool isCancelled(ChunkGenerator* generator)
+{
+    return loadAtomicPointer(&generator->pendingRequest) != NULL || loadAtomic(&generator->quit);
+}
+
+// normals may be NULL to derive them from the heights
+static void writeChunkUpload(ChunkGenerator* generator, ChunkRequest* request, float* heightMap, float* normals)
+{
+    if (request->uploadFormat == VERTEX_FORMAT_HEIGHT_TEXTURE) {
+        // All heights, then all packed normals
+        float* heights = (float*)request->upload;
+        GLshort* packedNormals = (GLshort*)(heights + CHUNK_WIDTH * CHUNK_LENGTH);
+        writeHeightMapTexels(heights, packedNormals, CHUNK_WIDTH, CHUNK_LENGTH, heightMap, normals, generator->pool);
+    }
+    else {
+        writeHeightMapPackedVertices((PackedVertex*)request->upload, CHUNK_WIDTH, CHUNK_LENGTH, heightMap, normals, generator->pool);
+    }
+}
+
+// Nothing reshapes the heights, so the analytic normals stay exact and the mesh skips its normal pass.
+// The noise graph only produces values, so this path evaluates gradient noise directly to get
+// the derivatives the normals come from.
+static Chunk* generateUnerodedChunk(ChunkGenerator* generator, ChunkRequest* request)
+{
+    float* normals = (float*)malloc(CHUNK_WIDTH * CHUNK_LENGTH * 3 * sizeof(float));
+    Noise* noise = createNoise(request->key.worldSeed, CHUNK_NOISE_HASH);
+    if (normals == NULL || noise == NULL) {
+        free(normals);
+        cleanNoise(noise);
+        return NULL;
+    }
+
+    float* heightMap = generateHeightMapNormals(CHUNK_WIDTH, CHUNK_LENGTH, CHUNK_HEIGHT_AMPLIFIER, noise, CHUNK_FREQUENCY, CHUNK_OCTAVES, request->offset, request->key.lod, normals, generator->pool);
+    cleanNoise(noise);
+
+    // The upload memory may belong to a newer request or to a renderer that is shutting down
+    if (heightMap == NULL || isCancelled(generator)) {
+        free(heightMap);
+        free(normals);
+        return NULL;
+    }
+
+    Chunk* chunk = (Chunk*)malloc(sizeof(Chunk));
+    chunk->key = request->key;
+    chunk->request = request->id;
+    chunk->heightMap = heightMap;
+    chunk->mesh = NULL;
+
+    if (request->upload != NULL)
+        writeChunkUpload(generator, request, heightMap, normals);
+    else
+        chunk->mesh = generateHeightMapMesh(CHUNK_WIDTH, CHUNK_LENGTH, heightMap, normals, generator->pool);
+    free(normals);
+
+    return chunk;
+}
+
+// Returns NULL when the request got cancelled on the way or its memory couldn't be allocated
+static Chunk* generateChunk(ChunkGenerator* generator, ChunkRequest* request)
+{
+    if (request->erosionEngine == EROSION_NONE)
+        return generateUnerodedChunk(generator, request);
+
+    Noise* noise = createNoise(request->key.worldSeed, CHUNK_NOISE_HASH);
+    if (noise == NULL)
+        return NULL;
+
+    NoiseGraph* graph = createNoiseGraph(noise);
+    float* heightMap = NULL;
+    if (graph != NULL) {
+        if (compileNoiseGraph(graph, addFbmNode(graph, CHUNK_FREQUENCY, CHUNK_OCTAVES)))
+            heightMap = generateHeightMapParallel(CHUNK_WIDTH, CHUNK_LENGTH, CHUNK_HEIGHT_AMPLIFIER, graph, request->offset, request->key.lod, generator->pool);
+        cleanNoiseGraph(graph);
+    }
+    cleanNoise(noise);
+
+    // An uncompiled graph or a failed allocation leaves nothing worth eroding
+    if (heightMap == NULL)
+        return NULL;
+
+    if (request->erosionEngine == EROSION_PIPES) {
+        if (!isCancelled(generator))
+            heightMap = erodeHeightMapHydraulic(heightMap, CHUNK_WIDTH, CHUNK_LENGTH, HYDRAULIC_ITERATIONS, generator->pool);
+    }
+    else {
+        // Every step runs whole phase slices across the pool and is a chance to notice a cancel.
+        // The AVX2 kernel erodes to a different map and only runs on some CPUs, so keyed chunks
+        // always take the scalar one to come out the same on every machine.
+        ErosionProgress erosion;
+        beginErosion(&erosion, heightMap, CHUNK_WIDTH, CHUNK_LENGTH, generator->brush, request->seed, EROSION_DROPLET_COUNT, false, generator->pool);
+        while (!isCancelled(generator) && !stepErosion(&erosion, EROSION_STEP_MS));
+    }
+
+    if (isCancelled(generator)) {
+        free(heightMap);
+        return NULL;
+    }
+
+    heightMap = erodeHeightMapThermal(heightMap, CHUNK_WIDTH, CHUNK_LENGTH, THERMAL_ITERATIONS, generator->pool);
+
+    // Thermal erosion is a window for a cancel too, which may take the upload memory with it
+    if (isCancelled(generator)) {
+        free(heightMap);
+        return NULL;
+    }
+
+    Chunk* chunk = (Chunk*)malloc(sizeof(Chunk));
+    chunk->key = request->key;
+    chunk->request = request->id;
+    chunk->heightMap = heightMap;
+    chunk->mesh = NULL;
+
+    if (request->upload != NULL)
+        writeChunkUpload(generator, request, heightMap, NULL);
+    else
+        chunk->mesh = generateHeightMapMesh(CHUNK_WIDTH, CHUNK_LENGTH, heightMap, NULL, generator->pool);
+
+    return chunk;
+}
+
+static void generatorMain(void* argument)
+{
+    ChunkGenerator* generator = (ChunkGenerator*)argument;
+
+    while (true) {
+        waitSignal(generator->wake);
+        if (loadAtomic(&generator->quit))
+            break;
+
+        ChunkRequest* request;
+        while ((request = (ChunkRequest*)exchangeAtomicPointer(&generator->pendingRequest, NULL)) != NULL) {
+            Chunk* chunk = generateChunk(generator, request);
+
+            if (chunk != NULL) {
+                // Replaces a chunk the main thread never took
+                Chunk* stale = (Chunk*)exchangeAtomicPointer(&generator->readyChunk, chunk);
+                if (stale != NULL)
+                    cleanChunk(stale);
+            }
+
+            // A request that failed is done as well, a cancelled one is followed by a newer request
+            storeAtomic(&generator->lastCompleted, request->id);
+
+            free(request);
+        }
+    }
+}
+
+// The pool is only used from the generator thread afterwards, runJobs must not be called on it elsewhere
+ChunkGenerator* createChunkGenerator(TerrainBrush* brush, ThreadPool* pool)
+{
+    ChunkGenerator* generator = (ChunkGenerator*)malloc(sizeof(ChunkGenerator));
+    generator->brush = brush;
+    generator->pool = pool;
+    generator->wake = createSignal();
+    generator->pendingRequest = NULL;
+    generator->readyChunk = NULL;
+    generator->lastRequest = 0;
+    generator->lastCompleted = 0;
+    generator->quit = 0;
+    generator->thread = createThread(generatorMain, generator);
+
+    return generator;
+}
+
+// Mixes the key into a seed for the per-chunk random streams, the noise field itself only
+// uses the world seed so it continues across chunk borders
+static unsigned int hashChunkKey(ChunkKey key)
+{
+    unsigned int h = (unsigned int)key.worldSeed;
+    h = (h ^ ((unsigned int)key.x * 0x9E3779B1u)) * 0x85EBCA6Bu;
+    h = (h ^ ((unsigned int)key.z * 0xC2B2AE35u)) * 0x27D4EB2Fu;
+    h = (h ^ ((unsigned int)key.lod * 0x165667B1u)) * 0x85EBCA6Bu;
+    h ^= h >> 16;
+    return h;
+}
+
+// upload receives the CHUNK_WIDTH * CHUNK_LENGTH vertices in uploadFormat instead of a new Mesh,
+// either VERTEX_FORMAT_PACKED or VERTEX_FORMAT_HEIGHT_TEXTURE laid out like beginRendererUpload.
+// Every request still in flight may write it, the chunk of the newest one is the only one
+// guaranteed complete. Returns the id the finished chunk carries.
+long requestChunk(ChunkGenerator* generator, ChunkKey key, ErosionEngine erosionEngine, void* upload, VertexFormat uploadFormat)
+{
+    ChunkRequest* request = (ChunkRequest*)malloc(sizeof(ChunkRequest));
+    request->id = ++generator->lastRequest;
+    request->key = key;
+
+    // A chunk spans CHUNK_WIDTH - 1 samples, so the last column of one is the first of the next
+    request->offset[0] = key.x * (CHUNK_WIDTH - 1);
+    request->offset[1] = key.z * (CHUNK_LENGTH - 1);
+    request->seed = hashChunkKey(key);
+    request->erosionEngine = erosionEngine;
+    request->upload = upload;
+    request->uploadFormat = uploadFormat;
+
+    // A request the worker hasn't started yet is simply replaced
+    ChunkRequest* replaced = (ChunkRequest*)exchangeAtomicPointer(&generator->pendingRequest, request);
+    free(replaced);
+
+    raiseSignal(generator->wake);
+
+    // The worker may already have freed the request
+    return generator->lastRequest;
+}
+
+// Returns the newest finished chunk or NULL, never blocks
+Chunk* takeChunk(ChunkGenerator* generator)
+{
+    return (Chunk*)exchangeAtomicPointer(&generator->readyChunk, NULL);
+}
+
+bool isGeneratingChunk(ChunkGenerator* generator)
+{
+    return loadAtomic(&generator->lastCompleted) != generator->lastRequest;
+}
+
+void cleanChunk(Chunk* chunk)
+{
+    if (chunk->mesh != NULL)
+        cleanMesh(chunk->mesh);
+    free(chunk->heightMap);
+    free(chunk);
+}
+
+void cleanChunkGenerator(ChunkGenerator* generator)
+{
+    storeAtomic(&generator->quit, 1);
+    raiseSignal(generator->wake);
+    cleanThread(generator->thread);
+
+    free(exchangeAtomicPointer(&generator->pendingRequest, NULL));
+
+    Chunk* chunk = takeChunk(generator);
+    if (chunk != NULL)
+        cleanChunk(chunk);
+
+    cleanSignal(generator->wake);
+    free(generator);
+}
\ No newline at end of file
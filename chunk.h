@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "mesh.h"
+#include "terrain.h"
+#include "thread.h"
+
+#define CHUNK_WIDTH 512
+#define CHUNK_LENGTH 512
+
+typedef enum {
+	EROSION_DROPLETS,
+	EROSION_PIPES,
+	EROSION_NONE // Gradient noise straight to the mesh, normals come from its derivatives
+} ErosionEngine;
+
+// Names a chunk, everything generated for it is a pure function of these fields
+typedef struct {
+	long worldSeed;
+	int x;   // Chunk grid position, neighbours share their border row and column of samples
+	int z;
+	int lod; // Samples are 1 << lod world units apart
+} ChunkKey;
+
+// Finished terrain, owned by whoever took it from the generator
+typedef struct {
+	ChunkKey key;
+	long request;     // Id requestChunk returned for it
+	Mesh* mesh;       // NULL when the vertices went straight into the upload passed to requestChunk
+	float* heightMap;
+} Chunk;
+
+// Runs the noise, erosion and normal pipeline on a background thread. Only the newest
+// request is worked on, requesting a chunk cancels the one in flight.
+typedef struct ChunkGenerator ChunkGenerator;
+
+ChunkGenerator* createChunkGenerator(TerrainBrush* brush, ThreadPool* pool);
+long requestChunk(ChunkGenerator* generator, ChunkKey key, ErosionEngine erosionEngine, void* upload, VertexFormat uploadFormat);
+Chunk* takeChunk(ChunkGenerator* generator);
+bool isGeneratingChunk(ChunkGenerator* generator);
+void cleanChunk(Chunk* chunk);
+void cleanChunkGenerator(ChunkGenerator* generator);
\ No newline at end of file
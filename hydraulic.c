@@ -0,0 +1,387 @@
+#include "hydraulic.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <emmintrin.h>
+
+// Virtual pipe model (Mei et al., "Fast Hydraulic Erosion Simulation and Visualization on GPU").
+// Every cell is connected to its four neighbours by pipes; water flows along height differences,
+// dissolves terrain proportionally to its speed and carries the sediment through the same pipes.
+
+// Simulation Parameters
+#define PIPE_TIME_STEP 0.02f
+#define PIPE_GRAVITY 9.81f
+#define PIPE_AREA 1.0f          // Cross section of a pipe
+#define PIPE_LENGTH 1.0f        // Distance between two cells
+#define RAIN_RATE 0.5f          // Water added to every cell per unit of time
+#define SEDIMENT_CAPACITY 0.5f
+#define DISSOLVE_RATE 0.5f
+#define DEPOSITION_RATE 1.0f
+#define EVAPORATION_RATE 0.015f
+#define MIN_TILT 0.05f          // Keeps some transport capacity on flat ground
+#define MIN_WATER 0.0001f
+
+// Rows handed to a worker at a time
+#define PIPE_BAND_ROWS 16
+
+// Height of the padding ring around the grid, water never flows out into it
+#define BORDER_HEIGHT 1e9f
+
+typedef struct {
+    int width;
+    int height;
+    int stride;       // width + 2, the grid carries a one cell border on every side
+    float* terrain;
+    float* nextTerrain;
+    float* water;
+    float* sediment;
+    float* transportedSediment;
+    float* fluxLeft;
+    float* fluxRight;
+    float* fluxTop;
+    float* fluxBottom;
+    float* volumeScale; // Time step over the water volume, turns a flux into the fraction of the cell it drains
+} PipeGrid;
+
+typedef void (*RowFunction)(PipeGrid* grid, int y);
+
+typedef struct {
+    PipeGrid* grid;
+    RowFunction row;
+} PipeJob;
+
+// Rows are processed 4 cells at a time with SSE, which every x64 CPU has. The
+// scalar cell functions handle the remainder of a row and mirror the SSE math.
+
+static inline __m128 selectPs(__m128 mask, __m128 a, __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// Outflow through each pipe, scaled down so a cell never sends more water than it holds
+static inline void updateFluxCell(PipeGrid* grid, int i)
+{
+    const int stride = grid->stride;
+    const float* terrain = grid->terrain;
+    const float* water = grid->water;
+    const float fluxFactor = PIPE_TIME_STEP * PIPE_AREA * PIPE_GRAVITY / PIPE_LENGTH;
+
+    float surface = terrain[i] + water[i];
+
+    float left = fmaxf(0.0f, grid->fluxLeft[i] + fluxFactor * (surface - terrain[i - 1] - water[i - 1]));
+    float right = fmaxf(0.0f, grid->fluxRight[i] + fluxFactor * (surface - terrain[i + 1] - water[i + 1]));
+    float top = fmaxf(0.0f, grid->fluxTop[i] + fluxFactor * (surface - terrain[i - stride] - water[i - stride]));
+    float bottom = fmaxf(0.0f, grid->fluxBottom[i] + fluxFactor * (surface - terrain[i + stride] - water[i + stride]));
+
+    float waterVolume = (water[i] + PIPE_TIME_STEP * RAIN_RATE) * PIPE_LENGTH * PIPE_LENGTH;
+    float outflow = (left + right + top + bottom) * PIPE_TIME_STEP;
+    float scale = fminf(1.0f, waterVolume / fmaxf(outflow, MIN_WATER));
+
+    grid->fluxLeft[i] = left * scale;
+    grid->fluxRight[i] = right * scale;
+    grid->fluxTop[i] = top * scale;
+    grid->fluxBottom[i] = bottom * scale;
+    grid->volumeScale[i] = PIPE_TIME_STEP / fmaxf(waterVolume, MIN_WATER);
+}
+
+static void updateFluxRow(PipeGrid* grid, int y)
+{
+    const int stride = grid->stride;
+    const float* terrain = grid->terrain;
+    const float* water = grid->water;
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 fluxFactor = _mm_set1_ps(PIPE_TIME_STEP * PIPE_AREA * PIPE_GRAVITY / PIPE_LENGTH);
+    const __m128 timeStep = _mm_set1_ps(PIPE_TIME_STEP);
+    const __m128 rain = _mm_set1_ps(PIPE_TIME_STEP * RAIN_RATE);
+    const __m128 cellArea = _mm_set1_ps(PIPE_LENGTH * PIPE_LENGTH);
+    const __m128 minWater = _mm_set1_ps(MIN_WATER);
+
+    int i = (y + 1) * stride + 1;
+    const int end = i + grid->width;
+
+    for (; i + 4 <= end; i += 4) {
+        __m128 ownWater = _mm_loadu_ps(water + i);
+        __m128 surface = _mm_add_ps(_mm_loadu_ps(terrain + i), ownWater);
+
+        __m128 surfaceLeft = _mm_add_ps(_mm_loadu_ps(terrain + i - 1), _mm_loadu_ps(water + i - 1));
+        __m128 surfaceRight = _mm_add_ps(_mm_loadu_ps(terrain + i + 1), _mm_loadu_ps(water + i + 1));
+        __m128 surfaceTop = _mm_add_ps(_mm_loadu_ps(terrain + i - stride), _mm_loadu_ps(water + i - stride));
+        __m128 surfaceBottom = _mm_add_ps(_mm_loadu_ps(terrain + i + stride), _mm_loadu_ps(water + i + stride));
+
+        __m128 left = _mm_max_ps(zero, _mm_add_ps(_mm_loadu_ps(grid->fluxLeft + i), _mm_mul_ps(fluxFactor, _mm_sub_ps(surface, surfaceLeft))));
+        __m128 right = _mm_max_ps(zero, _mm_add_ps(_mm_loadu_ps(grid->fluxRight + i), _mm_mul_ps(fluxFactor, _mm_sub_ps(surface, surfaceRight))));
+        __m128 top = _mm_max_ps(zero, _mm_add_ps(_mm_loadu_ps(grid->fluxTop + i), _mm_mul_ps(fluxFactor, _mm_sub_ps(surface, surfaceTop))));
+        __m128 bottom = _mm_max_ps(zero, _mm_add_ps(_mm_loadu_ps(grid->fluxBottom + i), _mm_mul_ps(fluxFactor, _mm_sub_ps(surface, surfaceBottom))));
+
+        __m128 waterVolume = _mm_mul_ps(_mm_add_ps(ownWater, rain), cellArea);
+        __m128 outflow = _mm_mul_ps(_mm_add_ps(_mm_add_ps(left, right), _mm_add_ps(top, bottom)), timeStep);
+        __m128 scale = _mm_min_ps(one, _mm_div_ps(waterVolume, _mm_max_ps(outflow, minWater)));
+
+        _mm_storeu_ps(grid->fluxLeft + i, _mm_mul_ps(left, scale));
+        _mm_storeu_ps(grid->fluxRight + i, _mm_mul_ps(right, scale));
+        _mm_storeu_ps(grid->fluxTop + i, _mm_mul_ps(top, scale));
+        _mm_storeu_ps(grid->fluxBottom + i, _mm_mul_ps(bottom, scale));
+        _mm_storeu_ps(grid->volumeScale + i, _mm_div_ps(timeStep, _mm_max_ps(waterVolume, minWater)));
+    }
+
+    for (; i < end; i++)
+        updateFluxCell(grid, i);
+}
+
+// Moves water along the fluxes, derives the velocity and dissolves terrain where the water
+// can carry more sediment than it does, deposits otherwise
+static inline void updateWaterCell(PipeGrid* grid, int i)
+{
+    const int stride = grid->stride;
+    const float* terrain = grid->terrain;
+    const float* fluxLeft = grid->fluxLeft;
+    const float* fluxRight = grid->fluxRight;
+    const float* fluxTop = grid->fluxTop;
+    const float* fluxBottom = grid->fluxBottom;
+
+    float inflow = fluxRight[i - 1] + fluxLeft[i + 1] + fluxBottom[i - stride] + fluxTop[i + stride];
+    float outflow = fluxLeft[i] + fluxRight[i] + fluxTop[i] + fluxBottom[i];
+
+    float rained = grid->water[i] + PIPE_TIME_STEP * RAIN_RATE;
+    float moved = fmaxf(0.0f, rained + PIPE_TIME_STEP * (inflow - outflow) / (PIPE_LENGTH * PIPE_LENGTH));
+    float averageWater = fmaxf((rained + moved) * 0.5f, MIN_WATER);
+
+    float flowX = (fluxRight[i - 1] - fluxLeft[i] + fluxRight[i] - fluxLeft[i + 1]) * 0.5f;
+    float flowY = (fluxBottom[i - stride] - fluxTop[i] + fluxBottom[i] - fluxTop[i + stride]) * 0.5f;
+    float velocityX = flowX / (PIPE_LENGTH * averageWater);
+    float velocityY = flowY / (PIPE_LENGTH * averageWater);
+
+    grid->water[i] = moved;
+
+    // Neighbours in the padding ring fall back to a one sided difference
+    float own = terrain[i];
+    float left = terrain[i - 1] < BORDER_HEIGHT ? terrain[i - 1] : own;
+    float right = terrain[i + 1] < BORDER_HEIGHT ? terrain[i + 1] : own;
+    float top = terrain[i - stride] < BORDER_HEIGHT ? terrain[i - stride] : own;
+    float bottom = terrain[i + stride] < BORDER_HEIGHT ? terrain[i + stride] : own;
+
+    float slopeX = (right - left) * 0.5f / PIPE_LENGTH;
+    float slopeY = (bottom - top) * 0.5f / PIPE_LENGTH;
+    float slopeSquared = slopeX * slopeX + slopeY * slopeY;
+    float tilt = fmaxf(sqrtf(slopeSquared / (1.0f + slopeSquared)), MIN_TILT);
+
+    float speed = sqrtf(velocityX * velocityX + velocityY * velocityY);
+    float capacity = SEDIMENT_CAPACITY * tilt * speed;
+
+    float difference = capacity - grid->sediment[i];
+    float dissolved = fminf(PIPE_TIME_STEP * DISSOLVE_RATE * fmaxf(difference, 0.0f), own);
+    float deposited = PIPE_TIME_STEP * DEPOSITION_RATE * fmaxf(-difference, 0.0f);
+
+    grid->nextTerrain[i] = own - dissolved + deposited;
+    grid->transportedSediment[i] = grid->sediment[i] + dissolved - deposited;
+}
+
+static void updateWaterRow(PipeGrid* grid, int y)
+{
+    const int stride = grid->stride;
+    const float* terrain = grid->terrain;
+    const float* fluxLeft = grid->fluxLeft;
+    const float* fluxRight = grid->fluxRight;
+    const float* fluxTop = grid->fluxTop;
+    const float* fluxBottom = grid->fluxBottom;
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 timeStep = _mm_set1_ps(PIPE_TIME_STEP);
+    const __m128 rain = _mm_set1_ps(PIPE_TIME_STEP * RAIN_RATE);
+    const __m128 inverseCellArea = _mm_set1_ps(1.0f / (PIPE_LENGTH * PIPE_LENGTH));
+    const __m128 inversePipeLength = _mm_set1_ps(1.0f / PIPE_LENGTH);
+    const __m128 minWater = _mm_set1_ps(MIN_WATER);
+    const __m128 minTilt = _mm_set1_ps(MIN_TILT);
+    const __m128 borderHeight = _mm_set1_ps(BORDER_HEIGHT);
+    const __m128 capacityFactor = _mm_set1_ps(SEDIMENT_CAPACITY);
+    const __m128 dissolveRate = _mm_set1_ps(PIPE_TIME_STEP * DISSOLVE_RATE);
+    const __m128 depositionRate = _mm_set1_ps(PIPE_TIME_STEP * DEPOSITION_RATE);
+
+    int i = (y + 1) * stride + 1;
+    const int end = i + grid->width;
+
+    for (; i + 4 <= end; i += 4) {
+        __m128 rightOfLeft = _mm_loadu_ps(fluxRight + i - 1);
+        __m128 leftOfRight = _mm_loadu_ps(fluxLeft + i + 1);
+        __m128 bottomOfTop = _mm_loadu_ps(fluxBottom + i - stride);
+        __m128 topOfBottom = _mm_loadu_ps(fluxTop + i + stride);
+        __m128 ownLeft = _mm_loadu_ps(fluxLeft + i);
+        __m128 ownRight = _mm_loadu_ps(fluxRight + i);
+        __m128 ownTop = _mm_loadu_ps(fluxTop + i);
+        __m128 ownBottom = _mm_loadu_ps(fluxBottom + i);
+
+        __m128 inflow = _mm_add_ps(_mm_add_ps(rightOfLeft, leftOfRight), _mm_add_ps(bottomOfTop, topOfBottom));
+        __m128 outflow = _mm_add_ps(_mm_add_ps(ownLeft, ownRight), _mm_add_ps(ownTop, ownBottom));
+
+        __m128 rained = _mm_add_ps(_mm_loadu_ps(grid->water + i), rain);
+        __m128 moved = _mm_max_ps(zero, _mm_add_ps(rained, _mm_mul_ps(_mm_mul_ps(timeStep, _mm_sub_ps(inflow, outflow)), inverseCellArea)));
+        __m128 averageWater = _mm_max_ps(_mm_mul_ps(_mm_add_ps(rained, moved), half), minWater);
+
+        __m128 flowX = _mm_mul_ps(_mm_add_ps(_mm_sub_ps(rightOfLeft, ownLeft), _mm_sub_ps(ownRight, leftOfRight)), half);
+        __m128 flowY = _mm_mul_ps(_mm_add_ps(_mm_sub_ps(bottomOfTop, ownTop), _mm_sub_ps(ownBottom, topOfBottom)), half);
+        __m128 velocityScale = _mm_div_ps(inversePipeLength, averageWater);
+        __m128 velocityX = _mm_mul_ps(flowX, velocityScale);
+        __m128 velocityY = _mm_mul_ps(flowY, velocityScale);
+
+        _mm_storeu_ps(grid->water + i, moved);
+
+        // Neighbours in the padding ring fall back to a one sided difference
+        __m128 own = _mm_loadu_ps(terrain + i);
+        __m128 left = _mm_loadu_ps(terrain + i - 1);
+        __m128 right = _mm_loadu_ps(terrain + i + 1);
+        __m128 top = _mm_loadu_ps(terrain + i - stride);
+        __m128 bottom = _mm_loadu_ps(terrain + i + stride);
+        left = selectPs(_mm_cmplt_ps(left, borderHeight), left, own);
+        right = selectPs(_mm_cmplt_ps(right, borderHeight), right, own);
+        top = selectPs(_mm_cmplt_ps(top, borderHeight), top, own);
+        bottom = selectPs(_mm_cmplt_ps(bottom, borderHeight), bottom, own);
+
+        __m128 slopeX = _mm_mul_ps(_mm_mul_ps(_mm_sub_ps(right, left), half), inversePipeLength);
+        __m128 slopeY = _mm_mul_ps(_mm_mul_ps(_mm_sub_ps(bottom, top), half), inversePipeLength);
+        __m128 slopeSquared = _mm_add_ps(_mm_mul_ps(slopeX, slopeX), _mm_mul_ps(slopeY, slopeY));
+        __m128 tilt = _mm_max_ps(_mm_sqrt_ps(_mm_div_ps(slopeSquared, _mm_add_ps(one, slopeSquared))), minTilt);
+
+        __m128 speed = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(velocityX, velocityX), _mm_mul_ps(velocityY, velocityY)));
+        __m128 capacity = _mm_mul_ps(_mm_mul_ps(capacityFactor, tilt), speed);
+
+        __m128 sediment = _mm_loadu_ps(grid->sediment + i);
+        __m128 difference = _mm_sub_ps(capacity, sediment);
+        __m128 dissolved = _mm_min_ps(_mm_mul_ps(dissolveRate, _mm_max_ps(difference, zero)), own);
+        __m128 deposited = _mm_mul_ps(depositionRate, _mm_max_ps(_mm_sub_ps(zero, difference), zero));
+
+        _mm_storeu_ps(grid->nextTerrain + i, _mm_add_ps(_mm_sub_ps(own, dissolved), deposited));
+        _mm_storeu_ps(grid->transportedSediment + i, _mm_sub_ps(_mm_add_ps(sediment, dissolved), deposited));
+    }
+
+    for (; i < end; i++)
+        updateWaterCell(grid, i);
+}
+
+// Moves sediment through the pipes in the same proportion as the water and evaporates water.
+// Every cell gathers what its neighbours send it, so no sediment is created or lost.
+static inline void transportCell(PipeGrid* grid, int i)
+{
+    const int stride = grid->stride;
+    const float* transported = grid->transportedSediment;
+    const float* volumeScale = grid->volumeScale;
+
+    float kept = 1.0f - (grid->fluxLeft[i] + grid->fluxRight[i] + grid->fluxTop[i] + grid->fluxBottom[i]) * volumeScale[i];
+
+    grid->sediment[i] = transported[i] * kept
+        + transported[i - 1] * grid->fluxRight[i - 1] * volumeScale[i - 1]
+        + transported[i + 1] * grid->fluxLeft[i + 1] * volumeScale[i + 1]
+        + transported[i - stride] * grid->fluxBottom[i - stride] * volumeScale[i - stride]
+        + transported[i + stride] * grid->fluxTop[i + stride] * volumeScale[i + stride];
+
+    grid->water[i] *= 1.0f - EVAPORATION_RATE * PIPE_TIME_STEP;
+}
+
+static void transportRow(PipeGrid* grid, int y)
+{
+    const int stride = grid->stride;
+    const float* transported = grid->transportedSediment;
+    const float* volumeScale = grid->volumeScale;
+
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 evaporation = _mm_set1_ps(1.0f - EVAPORATION_RATE * PIPE_TIME_STEP);
+
+    int i = (y + 1) * stride + 1;
+    const int end = i + grid->width;
+
+    for (; i + 4 <= end; i += 4) {
+        __m128 outflow = _mm_add_ps(
+            _mm_add_ps(_mm_loadu_ps(grid->fluxLeft + i), _mm_loadu_ps(grid->fluxRight + i)),
+            _mm_add_ps(_mm_loadu_ps(grid->fluxTop + i), _mm_loadu_ps(grid->fluxBottom + i)));
+        __m128 kept = _mm_sub_ps(one, _mm_mul_ps(outflow, _mm_loadu_ps(volumeScale + i)));
+
+        __m128 fromLeft = _mm_mul_ps(_mm_loadu_ps(transported + i - 1), _mm_mul_ps(_mm_loadu_ps(grid->fluxRight + i - 1), _mm_loadu_ps(volumeScale + i - 1)));
+        __m128 fromRight = _mm_mul_ps(_mm_loadu_ps(transported + i + 1), _mm_mul_ps(_mm_loadu_ps(grid->fluxLeft + i + 1), _mm_loadu_ps(volumeScale + i + 1)));
+        __m128 fromTop = _mm_mul_ps(_mm_loadu_ps(transported + i - stride), _mm_mul_ps(_mm_loadu_ps(grid->fluxBottom + i - stride), _mm_loadu_ps(volumeScale + i - stride)));
+        __m128 fromBottom = _mm_mul_ps(_mm_loadu_ps(transported + i + stride), _mm_mul_ps(_mm_loadu_ps(grid->fluxTop + i + stride), _mm_loadu_ps(volumeScale + i + stride)));
+
+        __m128 sediment = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(transported + i), kept), _mm_add_ps(_mm_add_ps(fromLeft, fromRight), _mm_add_ps(fromTop, fromBottom)));
+        _mm_storeu_ps(grid->sediment + i, sediment);
+        _mm_storeu_ps(grid->water + i, _mm_mul_ps(_mm_loadu_ps(grid->water + i), evaporation));
+    }
+
+    for (; i < end; i++)
+        transportCell(grid, i);
+}
+
+static void runBand(void* context, int band)
+{
+    PipeJob* job = (PipeJob*)context;
+    int firstRow = band * PIPE_BAND_ROWS;
+    int lastRow = firstRow + PIPE_BAND_ROWS < job->grid->height ? firstRow + PIPE_BAND_ROWS : job->grid->height;
+
+    for (int y = firstRow; y < lastRow; y++)
+        job->row(job->grid, y);
+}
+
+// Runs one step of the simulation over all rows, rows within a step are independent
+static void runStep(PipeGrid* grid, RowFunction row, ThreadPool* pool)
+{
+    PipeJob job = { grid, row };
+    int bands = (grid->height + PIPE_BAND_ROWS - 1) / PIPE_BAND_ROWS;
+    runJobs(pool, runBand, &job, bands);
+}
+
+// Grid based erosion with a fixed iteration budget, so run time only depends on the map size
+float* erodeHeightMapHydraulic(float* heightMap, int width, int height, int iterations, ThreadPool* pool)
+{
+    PipeGrid grid;
+    grid.width = width;
+    grid.height = height;
+    grid.stride = width + 2;
+
+    size_t cellCount = (size_t)grid.stride * (height + 2);
+    float* buffers = (float*)calloc(cellCount * 10, sizeof(float));
+    if (buffers == NULL)
+        return heightMap;
+
+    grid.terrain = buffers;
+    grid.nextTerrain = buffers + cellCount;
+    grid.water = buffers + cellCount * 2;
+    grid.sediment = buffers + cellCount * 3;
+    grid.transportedSediment = buffers + cellCount * 4;
+    grid.fluxLeft = buffers + cellCount * 5;
+    grid.fluxRight = buffers + cellCount * 6;
+    grid.fluxTop = buffers + cellCount * 7;
+    grid.fluxBottom = buffers + cellCount * 8;
+    grid.volumeScale = buffers + cellCount * 9;
+
+    // Both terrain buffers carry the padding ring, only the interior is ever rewritten
+    for (size_t i = 0; i < cellCount; i++)
+        grid.terrain[i] = BORDER_HEIGHT;
+    for (int y = 0; y < height; y++)
+        memcpy(grid.terrain + (y + 1) * grid.stride + 1, heightMap + y * width, width * sizeof(float));
+    memcpy(grid.nextTerrain, grid.terrain, cellCount * sizeof(float));
+
+    for (int iteration = 0; iteration < iterations; iteration++) {
+        runStep(&grid, updateFluxRow, pool);
+        runStep(&grid, updateWaterRow, pool);
+
+        float* swap = grid.terrain;
+        grid.terrain = grid.nextTerrain;
+        grid.nextTerrain = swap;
+
+        runStep(&grid, transportRow, pool);
+    }
+
+    // Whatever is still suspended settles where it is
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int i = (y + 1) * grid.stride + x + 1;
+            heightMap[y * width + x] = grid.terrain[i] + grid.sediment[i];
+        }
+    }
+
+    free(buffers);
+
+    return heightMap;
+}
\ No newline at end of file
@@ -6,8 +6,6 @@
 #include <string.h>
 #include <math.h>
 #include <stdbool.h>
-#include <ft2build.h>
-#include <freetype/freetype.h>    
 
 #include "util.h"
 #include "math2.h"
@@ -16,6 +14,9 @@
 #include "mesh.h"
 #include "renderer.h"
 #include "camera.h"
+#include "text.h"
+#include "thread.h"
+#include "chunk.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -26,8 +27,9 @@ static float ROTATE_SPEED = 20;
 #define WIDTH  1280
 #define HEIGHT 720
 
-#define CHUNK_WIDTH 512
-#define CHUNK_LENGTH 512
+// How terrain reaches the GPU, VERTEX_FORMAT_PACKED keeps a vertex buffer for terrain.vert.
+// VERTEX_FORMAT_HEIGHT_TEXTURE draws through heightfield.vert but hasn't been run on a GL context yet.
+#define TERRAIN_VERTEX_FORMAT VERTEX_FORMAT_PACKED
 
 int FPS;
 
@@ -40,16 +42,6 @@ void cursorPositionCallback(GLFWwindow* window, double xpos, double ypos)
     mousePosition[1] = HEIGHT - ypos;
 }
 
-typedef struct {
-    GLuint TextureID;   // ID handle of the glyph texture
-    int Size[2];        // Size of glyph
-    int Bearing[2];     // Offset from baseline to left/top of glyph
-    GLuint Advance;     // Horizontal offset to advance to next glyph
-} Character;
-
-Character Characters[128];
-GLuint VAO, VBO;
-
 void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
 {
     if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS)
@@ -73,69 +65,6 @@ void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
     }
 }
 
-GLfloat* generateChunk(Mesh* mesh, float* offset, TerrainBrush* terrainBrush) {
-    // Random seed
-    long seed = rand();
-    GLfloat* heightMap = generateHeightMap(CHUNK_WIDTH, CHUNK_LENGTH, 150, seed, 0.01, 10, offset);
-    heightMap = erodeHeightMap(heightMap, CHUNK_WIDTH, CHUNK_LENGTH, terrainBrush);
-    mesh = applyHeightMap(mesh, heightMap);
-    updateNormals(mesh);
-    return heightMap;
-}
-void RenderText(Renderer* renderer, Character* characters, GLuint vao, GLuint vbo, char* text, float x, float y, float scale)
-{
-    // Activate corresponding render state    
-    glUseProgram(renderer->shader->program);
-    glActiveTexture(GL_TEXTURE0);
-    glBindVertexArray(vao);
-
-    GLint reflectionTextureLoc = glGetUniformLocation(renderer->shader->program, "mainTexture");
-    glUniform1i(reflectionTextureLoc, 0);
-
-    // Iterate through all characters
-    for (const char* c = text; *c; c++)
-    {
-        Character ch = Characters[(unsigned char)*c];
-
-        float xpos = x + ch.Bearing[0] * scale;
-        float ypos = y - (ch.Size[1] - ch.Bearing[1]) * scale;
-
-        float w = ch.Size[0] * scale;
-        float h = ch.Size[1] * scale;
-
-        float xposScaled = xpos / WIDTH * 2.0f - 1.0f;
-        float xposWScaled = (xpos + w) / WIDTH * 2.0f - 1.0f;
-
-        float yposScaled = ypos / HEIGHT * 2.0f - 1.0f;
-        float yposHScaled = (ypos + h) / HEIGHT * 2.0f - 1.0f;
-
-        // Update VBO for each character
-        float vertices[6][4] = {
-            { xposScaled, yposHScaled, 0.0f, 0.0f },
-            { xposScaled, yposScaled, 0.0f, 1.0f },
-            { xposWScaled, yposScaled, 1.0f, 1.0f },
-
-            { xposScaled,  yposHScaled, 0.0f, 0.0f },
-            { xposWScaled, yposScaled, 1.0f, 1.0f },
-            { xposWScaled, yposHScaled, 1.0f, 0.0f }
-        };
-
-        // Render glyph texture over quad
-        glBindTexture(GL_TEXTURE_2D, ch.TextureID);
-        // Update content of VBO memory
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        // Render quad
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-        // Now advance cursors for next glyph (note that advance is number of 1/64 pixels)
-        x += (ch.Advance >> 6) * scale; // Bitshift by 6 to get value in pixels (2^6 = 64)
-    }
-    glBindVertexArray(0);
-    glBindTexture(GL_TEXTURE_2D, 0);
-}
-
-
 int main()
 {
     // Initialize GLFW
@@ -167,87 +96,42 @@ int main()
         return -1;
     }
 
-    FT_Library ft;
-    if (FT_Init_FreeType(&ft)) {
-        fprintf(stderr, "Could not init FreeType Library\n");
-        return -1;
-    }
-
-    FT_Face face;
-    if (FT_New_Face(ft, "fonts/Cascadia.ttf", 0, &face)) {
-        fprintf(stderr, "Failed to load font\n");
-        return -1;
-    }
-
-
-    FT_Set_Pixel_Sizes(face, 0, 48);  // Set the size to load glyphs as 48x48 pixels
-
-    GLuint textVao;
-    glGenVertexArrays(1, &textVao);
-    glBindVertexArray(textVao);
-
-    GLuint textVbo;
-    glGenBuffers(1, &textVbo);
-    glBindBuffer(GL_ARRAY_BUFFER, textVbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 6 * 4, NULL, GL_DYNAMIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), 0);
-
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
-
-    // Load fps text to texture
-    for (unsigned char c = 0; c < 128; c++) {
-        // Load character glyph 
-        if (FT_Load_Char(face, c, FT_LOAD_RENDER)) {
-            fprintf(stderr, "Failed to load Glyph\n");
-            continue;
-        }
-        // Generate texture
-        GLuint glyphTexture;
-        glGenTextures(1, &glyphTexture);
-        glBindTexture(GL_TEXTURE_2D, glyphTexture);
-        glTexImage2D(
-            GL_TEXTURE_2D,
-            0,
-            GL_RED,
-            face->glyph->bitmap.width,
-            face->glyph->bitmap.rows,
-            0,
-            GL_RED,
-            GL_UNSIGNED_BYTE,
-            face->glyph->bitmap.buffer
-        );
-        // Set texture options
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        // Now store character for later use
-        Characters[c].TextureID = glyphTexture;
-        Characters[c].Size[0] = face->glyph->bitmap.width;
-        Characters[c].Size[1] = face->glyph->bitmap.rows;
-        Characters[c].Bearing[0] = face->glyph->bitmap_left;
-        Characters[c].Bearing[1] = face->glyph->bitmap_top;
-        Characters[c].Advance = face->glyph->advance.x;
-    }
-    glBindTexture(GL_TEXTURE_2D, 0);
+    // Pack the glyphs into a single atlas
+    Font* font = createFont("fonts/Cascadia.ttf", 48);
+    if (font == NULL)
+        return -1;
 
     // Set random seed
     srand(getTime());
 
     // Generate terrain
-    Shader* terrainShader = createShader("shaders/terrain.vert", "shaders/terrain.frag");
+    Shader* terrainShader = createShader(TERRAIN_VERTEX_FORMAT == VERTEX_FORMAT_HEIGHT_TEXTURE ? "shaders/heightfield.vert" : "shaders/terrain.vert", "shaders/terrain.frag");
 
-    // Allocate memory for brush indices and weights
+    // Erosion stencil shared by every heightmap cell
     TerrainBrush* terrainBrush = createTerrainBrush(CHUNK_WIDTH, CHUNK_LENGTH);
 
-    float offset[] = { 0, 0 };
-    Mesh* terrainMesh = generatePlaneMesh(CHUNK_WIDTH, CHUNK_LENGTH);
-    float* heightMap = generateChunk(terrainMesh, offset, terrainBrush);
+    // Worker threads for terrain generation, sized to the machine
+    ThreadPool* threadPool = createThreadPool(0);
+
+    // Erosion used by the next regeneration, 1 selects droplets, 2 the pipe model and 3 none
+    ErosionEngine erosionEngine = EROSION_DROPLETS;
 
-    Renderer* terrainRenderer = createRenderer(terrainMesh, terrainShader, NULL, 0);
+    // Chunks are generated in the background, the flat plane is shown until the first one arrives
+    ChunkGenerator* chunkGenerator = createChunkGenerator(terrainBrush, threadPool);
+    Chunk* terrainChunk = NULL;
+    bool regenerateHeld = false;
+
+    // The chunk at the world origin, regenerating rolls a new world. Chunks write their vertices
+    // straight into the renderer's spare buffer, the flat plane only lends them its indices.
+    // The height textures need no vertices from it at all.
+    ChunkKey chunkKey = { rand(), 0, 0, 0 };
+    Mesh* terrainMesh = TERRAIN_VERTEX_FORMAT == VERTEX_FORMAT_HEIGHT_TEXTURE
+        ? generateGridIndexMesh(CHUNK_WIDTH, CHUNK_LENGTH)
+        : generatePlaneMesh(CHUNK_WIDTH, CHUNK_LENGTH);
+    Renderer* terrainRenderer = createRenderer(terrainMesh, terrainShader, NULL, 0, TERRAIN_VERTEX_FORMAT);
+    long chunkRequest = requestChunk(chunkGenerator, chunkKey, erosionEngine, beginRendererUpload(terrainRenderer), TERRAIN_VERTEX_FORMAT);
 
     // Load the image
     int width, height, nrChannels;
@@ -386,7 +270,7 @@ int main()
         waterRefractionDepthTexture
     };
 
-    Renderer* waterRenderer = createRenderer(waterMesh, waterShader, waterTextures, 5);
+    Renderer* waterRenderer = createRenderer(waterMesh, waterShader, waterTextures, 5, VERTEX_FORMAT_MESH);
 
     // Button
     Shader* buttonShader = createShader("shaders/button.vert", "shaders/button.frag");
@@ -421,11 +305,10 @@ int main()
         exit(1);
     }
 
-    Renderer* buttonRenderer = createRenderer(buttonMesh, buttonShader, &buttonTexture, 1);
+    Renderer* buttonRenderer = createRenderer(buttonMesh, buttonShader, &buttonTexture, 1, VERTEX_FORMAT_MESH);
 
-    Mesh* textMesh = generateQuadMesh();
     Shader* textShader = createShader("shaders/text.vert", "shaders/text.frag");
-    Renderer* textRenderer = createRenderer(textMesh, textShader, 0, 0);
+    TextBatch* textBatch = createTextBatch(font, textShader, WIDTH, HEIGHT);
 
     // Set render mode
     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
@@ -455,6 +338,9 @@ int main()
 
     Camera* camera = createCamera(cameraTarget, cameraOffset, 30.0, (float) WIDTH / HEIGHT, 0.01f, 1000.0f);
 
+    // Camera data shared by all shaders, refilled once per pass
+    GLuint passBuffer = createPassBuffer();
+
     glEnable(GL_BLEND);
 
     GLFWcursor* defaultCursor = glfwCreateStandardCursor(GLFW_CURSOR_NORMAL);
@@ -487,6 +373,13 @@ int main()
         if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
             camera->rotation[1] += ROTATE_SPEED * deltaTime;
 
+        if (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS)
+            erosionEngine = EROSION_DROPLETS;
+        if (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS)
+            erosionEngine = EROSION_PIPES;
+        if (glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS)
+            erosionEngine = EROSION_NONE;
+
         float radians = toRadians(camera->rotation[1]);
 
         float forwardX = cosf(radians);
@@ -542,17 +435,43 @@ int main()
             mousePosition[1] >= buttonPixelPosition[1] && mousePosition[1] <= buttonPixelPosition[1] + buttonPixelScale[1])
         {
             glfwSetCursor(window, handCursor);
-            if (mouseButtonsPressed[0])
+            // A click while a chunk is still generating cancels it in favour of the new one
+            if (mouseButtonsPressed[0] && !regenerateHeld)
             {
                 printf("New chunk generating...\n");
-                heightMap = generateChunk(terrainMesh, offset, terrainBrush);
-                printf("New chunk generated!\n");
+                chunkKey.worldSeed = rand();
+                chunkRequest = requestChunk(chunkGenerator, chunkKey, erosionEngine, beginRendererUpload(terrainRenderer), TERRAIN_VERTEX_FORMAT);
             }
         }
         else
         {
             glfwSetCursor(window, defaultCursor);
         }
+        regenerateHeld = mouseButtonsPressed[0];
+
+        // Swap in a finished chunk, the renderer no longer references the previous mesh afterwards.
+        // A chunk written into the spare buffer is only complete there if no newer request followed it.
+        Chunk* finishedChunk = takeChunk(chunkGenerator);
+        if (finishedChunk != NULL && finishedChunk->mesh == NULL && finishedChunk->request != chunkRequest) {
+            cleanChunk(finishedChunk);
+            finishedChunk = NULL;
+        }
+        if (finishedChunk != NULL) {
+            if (finishedChunk->mesh != NULL) {
+                setRendererMesh(terrainRenderer, finishedChunk->mesh);
+            }
+            else {
+                // The vertices are already in the GPU buffer, the plane lends its indices
+                if (terrainRenderer->mesh != terrainMesh)
+                    setRendererMesh(terrainRenderer, terrainMesh);
+                endRendererUpload(terrainRenderer);
+            }
+
+            if (terrainChunk != NULL)
+                cleanChunk(terrainChunk);
+            terrainChunk = finishedChunk;
+            printf("New chunk generated!\n");
+        }
 
         glEnable(GL_CLIP_DISTANCE0);
 
@@ -587,7 +506,8 @@ int main()
 
         camera->targetOffset[1] *= -1;
         updateCamera(camera);
-        renderMesh(terrainRenderer, terrainModelMatrix, camera, reflectionClipPlane);
+        updatePassBuffer(passBuffer, camera, reflectionClipPlane);
+        renderMesh(terrainRenderer, terrainModelMatrix);
         camera->targetOffset[1] *= -1;
         updateCamera(camera);
 
@@ -598,22 +518,28 @@ int main()
 
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        renderMesh(terrainRenderer, terrainModelMatrix, camera, refractionClipPlane);
+        updatePassBuffer(passBuffer, camera, refractionClipPlane);
+        renderMesh(terrainRenderer, terrainModelMatrix);
 
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
         glDisable(GL_CLIP_DISTANCE0);
 
-        renderMesh(terrainRenderer, terrainModelMatrix, camera, NULL);
-        renderMesh(waterRenderer, waterModelMatrix, camera, NULL);
+        updatePassBuffer(passBuffer, camera, NULL);
+        renderMesh(terrainRenderer, terrainModelMatrix);
+        renderMesh(waterRenderer, waterModelMatrix);
 
         glDisable(GL_DEPTH_TEST);
         renderUI(buttonRenderer, buttonPosition, buttonScale);
         float textColor[] = { 1.0f, 1.0f, 1.0f };
         char fpsString[16];
         sprintf_s(fpsString, 16, "FPS:%d", FPS);
-        RenderText(textRenderer, Characters, textVao, textVbo, fpsString, 10.0f, 660.0f, 1.0f);
-        RenderText(textRenderer, Characters, textVao, textVbo, "REGENERATE", 1170.0f, 630.0f, 0.3f);
+        addText(textBatch, fpsString, 10.0f, 660.0f, 1.0f);
+        addText(textBatch, "REGENERATE", 1170.0f, 630.0f, 0.3f);
+        addText(textBatch, erosionEngine == EROSION_PIPES ? "EROSION: PIPES" : (erosionEngine == EROSION_NONE ? "EROSION: NONE" : "EROSION: DROPLETS"), 10.0f, 620.0f, 0.4f);
+        if (isGeneratingChunk(chunkGenerator))
+            addText(textBatch, "GENERATING...", 10.0f, 590.0f, 0.4f);
+        renderText(textBatch);
 
         // Swap front and back buffers
         glfwSwapBuffers(window);
@@ -622,9 +548,14 @@ int main()
         glfwPollEvents();
     }
 
-    // Clean up
+    // Clean up. The generator goes first, its worker may still be writing into the renderer's mapped buffer.
+    cleanChunkGenerator(chunkGenerator);
     cleanShader(terrainShader);
     cleanRenderer(terrainRenderer);
+    if (terrainChunk != NULL)
+        cleanChunk(terrainChunk);
+    cleanMesh(terrainMesh);
+    cleanThreadPool(threadPool);
 
     // Terminate GLFW
     glfwTerminate();
@@ -69,6 +69,34 @@ void setModelMatrix(float translation[3], float rotation[3], float scale[3], flo
     matrix[15] = 1.0f;
 }
 
+// Inverse transpose of the model's upper 3x3, written column-major into 9 floats
+void setNormalMatrix(const float* m, float* normalMatrix) {
+    // Cofactors of the upper 3x3 (m is column-major, m[column * 4 + row])
+    float c00 = m[5] * m[10] - m[9] * m[6];
+    float c01 = -(m[1] * m[10] - m[9] * m[2]);
+    float c02 = m[1] * m[6] - m[5] * m[2];
+    float c10 = -(m[4] * m[10] - m[8] * m[6]);
+    float c11 = m[0] * m[10] - m[8] * m[2];
+    float c12 = -(m[0] * m[6] - m[4] * m[2]);
+    float c20 = m[4] * m[9] - m[8] * m[5];
+    float c21 = -(m[0] * m[9] - m[8] * m[1]);
+    float c22 = m[0] * m[5] - m[4] * m[1];
+
+    float det = m[0] * c00 + m[4] * c01 + m[8] * c02;
+    float invDet = det != 0.0f ? 1.0f / det : 0.0f;
+
+    // The inverse transpose is the cofactor matrix divided by the determinant
+    normalMatrix[0] = c00 * invDet;
+    normalMatrix[1] = c10 * invDet;
+    normalMatrix[2] = c20 * invDet;
+    normalMatrix[3] = c01 * invDet;
+    normalMatrix[4] = c11 * invDet;
+    normalMatrix[5] = c21 * invDet;
+    normalMatrix[6] = c02 * invDet;
+    normalMatrix[7] = c12 * invDet;
+    normalMatrix[8] = c22 * invDet;
+}
+
 void lookAt(float* viewMatrix, const float* eye, const float* center, const float* down) {
     float forward[3], right[3], upVector[3];
 
@@ -2,24 +2,107 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <xmmintrin.h>
 
 #include "math2.h"
 
-Mesh* generatePlaneMesh(int width, int length)
+// Rows handed to a worker at a time by the heightfield vertex kernel
+#define VERTEX_BAND_ROWS 16
+
+typedef struct {
+    float* vertices;
+    PackedVertex* packed;   // Written instead of vertices when not NULL
+    float* heights;         // Written with packedNormals instead of vertices when not NULL
+    GLshort* packedNormals;
+    int stride;             // Floats from one vertex to the next, at least MESH_VERTEX_FLOATS
+    int width;
+    int length;
+    const float* heightMap; // One height per vertex, row after row
+    const float* normals;   // 3 floats per vertex, NULL derives them from the heights
+} GridVertexJob;
+
+static Mesh* updateFaceNormals(Mesh* mesh);
+static void writeGridVertices(Mesh* mesh, const float* heightMap, const float* normals, ThreadPool* pool);
+
+// Two triangles per quad of a width x length vertex grid
+static void fillGridIndices(Mesh* mesh, int width, int length)
 {
-    Mesh* mesh = (Mesh*) malloc(sizeof(Mesh));
+    int index = 0;
+
+    for (int z = 0; z < length - 1; z++)
+    {
+        for (int x = 0; x < width - 1; x++)
+        {
+            int topLeft = z * width + x;
+            int topRight = topLeft + 1;
+            int bottomLeft = (z + 1) * width + x;
+            int bottomRight = bottomLeft + 1;
+
+            // First triangle
+            mesh->indices[index++] = topLeft;
+            mesh->indices[index++] = bottomLeft;
+            mesh->indices[index++] = topRight;
+
+            // Second triangle
+            mesh->indices[index++] = topRight;
+            mesh->indices[index++] = bottomLeft;
+            mesh->indices[index++] = bottomRight;
+        }
+    }
+}
+
+static Mesh* allocateGridMesh(int width, int length)
+{
+    Mesh* mesh = (Mesh*)malloc(sizeof(Mesh));
 
     mesh->vertexCount = width * length;
-    mesh->vertices = (GLfloat*) malloc(mesh->vertexCount * 5 * sizeof(GLfloat));
+    mesh->vertices = (GLfloat*)malloc(mesh->vertexCount * MESH_VERTEX_FLOATS * sizeof(GLfloat));
+
+    mesh->indexCount = (width - 1) * (length - 1) * 6;
+    mesh->indices = (GLint*)malloc(mesh->indexCount * sizeof(GLint));
+
+    mesh->version = 0;
+    mesh->gridWidth = width;
+
+    fillGridIndices(mesh, width, length);
+
+    return mesh;
+}
 
-    mesh->normals = (GLfloat*)malloc(mesh->vertexCount * 3 * sizeof(GLfloat));
+// Grid topology without vertices, for VERTEX_FORMAT_HEIGHT_TEXTURE renderers that fetch every
+// vertex from their textures. Drawn flat until the first upload.
+Mesh* generateGridIndexMesh(int width, int length)
+{
+    Mesh* mesh = (Mesh*)malloc(sizeof(Mesh));
+    if (mesh == NULL)
+        return NULL;
+
+    mesh->vertexCount = width * length;
+    mesh->vertices = NULL;
 
     mesh->indexCount = (width - 1) * (length - 1) * 6;
-    mesh->indices = (GLint*) malloc(mesh->indexCount * sizeof(GLint));
+    mesh->indices = (GLint*)malloc(mesh->indexCount * sizeof(GLint));
+    if (mesh->indices == NULL) {
+        free(mesh);
+        return NULL;
+    }
+
+    mesh->version = 0;
+    mesh->gridWidth = width;
 
+    fillGridIndices(mesh, width, length);
+
+    return mesh;
+}
+
+// Flat grid, every normal points straight up so no normal pass is needed
+Mesh* generatePlaneMesh(int width, int length)
+{
+    Mesh* mesh = allocateGridMesh(width, length);
 
     int vertexIndex = 0;
-    int index = 0;
 
     for (int z = 0; z < length; z++)
     {
@@ -34,28 +117,25 @@ Mesh* generatePlaneMesh(int width, int length)
             mesh->vertices[vertexIndex++] = (float)x / (float)(width - 1);
             mesh->vertices[vertexIndex++] = (float)z / (float)(length - 1);
 
-            // Calculate indices for two triangles, but only if not on the last row/column
-            if (z < length - 1 && x < width - 1)
-            {
-                int topLeft = z * width + x;
-                int topRight = topLeft + 1;
-                int bottomLeft = (z + 1) * width + x;
-                int bottomRight = bottomLeft + 1;
-
-                // First triangle
-                mesh->indices[index++] = topLeft;
-                mesh->indices[index++] = bottomLeft;
-                mesh->indices[index++] = topRight;
-
-                // Second triangle
-                mesh->indices[index++] = topRight;
-                mesh->indices[index++] = bottomLeft;
-                mesh->indices[index++] = bottomRight;
-            }
+            // Normal
+            mesh->vertices[vertexIndex++] = 0.0f;
+            mesh->vertices[vertexIndex++] = 1.0f;
+            mesh->vertices[vertexIndex++] = 0.0f;
         }
     }
 
-    mesh = updateNormals(mesh);
+    return mesh;
+}
+
+// Grid with the heights already applied, built in a single pass over the heightmap.
+// The same as generatePlaneMesh followed by applyHeightMap without touching every vertex three times.
+// normals may be NULL to derive them from the heights, otherwise 3 floats per vertex computed
+// alongside the heights.
+Mesh* generateHeightMapMesh(int width, int length, float* heightMap, float* normals, ThreadPool* pool)
+{
+    Mesh* mesh = allocateGridMesh(width, length);
+
+    writeGridVertices(mesh, heightMap, normals, pool);
 
     return mesh;
 }
@@ -68,16 +148,16 @@ Mesh* generateQuadMesh()
     int height = 2;
 
     mesh->vertexCount = width * height;
-    mesh->vertices = (GLfloat*)malloc(mesh->vertexCount * 5 * sizeof(GLfloat));
-
-    mesh->normals = (GLfloat*)malloc(mesh->vertexCount * 3 * sizeof(GLfloat));
+    mesh->vertices = (GLfloat*)malloc(mesh->vertexCount * MESH_VERTEX_FLOATS * sizeof(GLfloat));
 
     mesh->indexCount = (width - 1) * (height - 1) * 6;
     mesh->indices = (GLint*)malloc(mesh->indexCount * sizeof(GLint));
 
+    mesh->version = 0;
+    mesh->gridWidth = 0;
+
 
     int vertexIndex = 0;
-    int index = 0;
 
     for (int y = 0; y < height; y++)
     {
@@ -92,47 +172,310 @@ Mesh* generateQuadMesh()
             mesh->vertices[vertexIndex++] = (float)x / (float)(width - 1);
             mesh->vertices[vertexIndex++] = (float)y / (float)(height - 1);
 
-            // Calculate indices for two triangles, but only if not on the last row/column
-            if (y < height - 1 && x < width - 1)
-            {
-                int topLeft = y * width + x;
-                int topRight = topLeft + 1;
-                int bottomLeft = (y + 1) * width + x;
-                int bottomRight = bottomLeft + 1;
-
-                // First triangle
-                mesh->indices[index++] = topLeft;
-                mesh->indices[index++] = bottomLeft;
-                mesh->indices[index++] = topRight;
-
-                // Second triangle
-                mesh->indices[index++] = topRight;
-                mesh->indices[index++] = bottomLeft;
-                mesh->indices[index++] = bottomRight;
-            }
+            // Normal, filled in by updateNormals
+            vertexIndex += 3;
         }
     }
 
+    fillGridIndices(mesh, width, height);
+
     mesh = updateNormals(mesh);
 
     return mesh;
 }
 
+// Heightfield normal from central differences, (-dh/dx, 1, -dh/dz) normalized. Edge vertices
+// fall back to one-sided differences, above and below point at the row itself there.
+static inline void heightFieldNormal(float* normal, const float* row, const float* above, const float* below, float zScale, int x, int width)
+{
+    int left = x > 0 ? x - 1 : x;
+    int right = x < width - 1 ? x + 1 : x;
+
+    float normalX = -(row[right] - row[left]) / (float)(right - left);
+    float normalZ = -(below[x] - above[x]) * zScale;
+    float inverseLength = 1.0f / sqrtf(normalX * normalX + 1.0f + normalZ * normalZ);
+
+    normal[0] = normalX * inverseLength;
+    normal[1] = inverseLength;
+    normal[2] = normalZ * inverseLength;
+}
+
+static inline void writeGridVertex(float* vertex, const float* row, const float* above, const float* below, const float* normals,
+    float zScale, int x, int z, int width, float texCoordV)
+{
+    vertex[0] = x;
+    vertex[1] = row[x];
+    vertex[2] = z;
+    vertex[3] = (float)x / (float)(width - 1);
+    vertex[4] = texCoordV;
+
+    if (normals != NULL)
+        memcpy(vertex + MESH_NORMAL_OFFSET, normals + x * 3, 3 * sizeof(float));
+    else
+        heightFieldNormal(vertex + MESH_NORMAL_OFFSET, row, above, below, zScale, x, width);
+}
+
+// Writes whole vertices of one grid row. Interior columns go 4 at a time with SSE, two 4x4
+// transposes turn the attribute vectors into (x, y, z, u) and (v, nx, ny, nz) halves.
+static void writeGridRow(float* vertices, int stride, const float* row, const float* above, const float* below, const float* normals,
+    float zScale, int z, int width, int length)
+{
+    const float texCoordV = (float)z / (float)(length - 1);
+
+    writeGridVertex(vertices, row, above, below, normals, zScale, 0, z, width, texCoordV);
+
+    int x = 1;
+    if (normals == NULL) {
+        const __m128 half = _mm_set1_ps(-0.5f);
+        const __m128 scale = _mm_set1_ps(-zScale);
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 step = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+        const __m128 texCoordScale = _mm_set1_ps((float)(width - 1));
+        const __m128 positionZ = _mm_set1_ps((float)z);
+        const __m128 texCoordZ = _mm_set1_ps(texCoordV);
+
+        for (; x + 4 < width; x += 4) {
+            __m128 normalX = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(row + x + 1), _mm_loadu_ps(row + x - 1)), half);
+            __m128 normalZ = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(below + x), _mm_loadu_ps(above + x)), scale);
+            __m128 magnitude = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(normalX, normalX), one), _mm_mul_ps(normalZ, normalZ)));
+            __m128 inverseLength = _mm_div_ps(one, magnitude);
+
+            __m128 positionX = _mm_add_ps(_mm_set1_ps((float)x), step);
+            __m128 a = positionX;
+            __m128 b = _mm_loadu_ps(row + x);
+            __m128 c = positionZ;
+            __m128 d = _mm_div_ps(positionX, texCoordScale);
+            _MM_TRANSPOSE4_PS(a, b, c, d);
+
+            __m128 e = texCoordZ;
+            __m128 f = _mm_mul_ps(normalX, inverseLength);
+            __m128 g = inverseLength;
+            __m128 h = _mm_mul_ps(normalZ, inverseLength);
+            _MM_TRANSPOSE4_PS(e, f, g, h);
+
+            float* out = vertices + x * stride;
+            _mm_storeu_ps(out, a);
+            _mm_storeu_ps(out + 4, e);
+            _mm_storeu_ps(out + stride, b);
+            _mm_storeu_ps(out + stride + 4, f);
+            _mm_storeu_ps(out + stride * 2, c);
+            _mm_storeu_ps(out + stride * 2 + 4, g);
+            _mm_storeu_ps(out + stride * 3, d);
+            _mm_storeu_ps(out + stride * 3 + 4, h);
+        }
+    }
+
+    for (; x < width; x++)
+        writeGridVertex(vertices + x * stride, row, above, below, normals, zScale, x, z, width, texCoordV);
+}
+
+// Octahedral normal encoding around the y axis, the upper hemisphere maps to the inner diamond
+// and the lower one is folded over its edges
+static inline void packNormal(GLshort* packed, const float* normal)
+{
+    float sum = fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]);
+    float u = sum > 0.0f ? normal[0] / sum : 0.0f;
+    float v = sum > 0.0f ? normal[2] / sum : 0.0f;
+
+    if (normal[1] < 0.0f) {
+        float foldedU = (1.0f - fabsf(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+        float foldedV = (1.0f - fabsf(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+        u = foldedU;
+        v = foldedV;
+    }
+
+    packed[0] = (GLshort)lrintf(u * 32767.0f);
+    packed[1] = (GLshort)lrintf(v * 32767.0f);
+}
+
+static inline void packVertex(PackedVertex* packed, const float* vertex)
+{
+    float height = (vertex[1] - PACKED_HEIGHT_MIN) / PACKED_HEIGHT_STEP + 0.5f;
+    height = height < 0.0f ? 0.0f : (height > 65535.0f ? 65535.0f : height);
+
+    packed->x = (GLushort)vertex[0];
+    packed->z = (GLushort)vertex[2];
+    packed->height = (GLushort)height;
+    packed->padding = 0;
+    packNormal(packed->normal, vertex + MESH_NORMAL_OFFSET);
+}
+
+static void writeGridVertexBand(void* context, int band)
+{
+    GridVertexJob* job = (GridVertexJob*)context;
+    const int width = job->width;
+    const int length = job->length;
+
+    int firstRow = band * VERTEX_BAND_ROWS;
+    int lastRow = firstRow + VERTEX_BAND_ROWS - 1 < length - 1 ? firstRow + VERTEX_BAND_ROWS - 1 : length - 1;
+
+    // Packed rows go through one float row that stays in cache
+    float* scratch = NULL;
+    if (job->packed != NULL || job->heights != NULL) {
+        scratch = (float*)malloc(width * MESH_VERTEX_FLOATS * sizeof(float));
+        if (scratch == NULL)
+            return;
+    }
+
+    for (int z = firstRow; z <= lastRow; z++) {
+        int above = z > 0 ? z - 1 : z;
+        int below = z < length - 1 ? z + 1 : z;
+        float zScale = 1.0f / (float)(below - above);
+
+        float* vertices = scratch != NULL ? scratch : job->vertices + z * width * job->stride;
+        int stride = scratch != NULL ? MESH_VERTEX_FLOATS : job->stride;
+
+        writeGridRow(vertices, stride, job->heightMap + z * width,
+            job->heightMap + above * width, job->heightMap + below * width,
+            job->normals != NULL ? job->normals + z * width * 3 : NULL, zScale, z, width, length);
+
+        if (job->packed != NULL) {
+            PackedVertex* packed = job->packed + z * width;
+            for (int x = 0; x < width; x++)
+                packVertex(packed + x, scratch + x * MESH_VERTEX_FLOATS);
+        }
+        else if (job->heights != NULL) {
+            memcpy(job->heights + z * width, job->heightMap + z * width, width * sizeof(float));
+
+            GLshort* packedNormals = job->packedNormals + z * width * 2;
+            for (int x = 0; x < width; x++)
+                packNormal(packedNormals + x * 2, scratch + x * MESH_VERTEX_FLOATS + MESH_NORMAL_OFFSET);
+        }
+    }
+
+    free(scratch);
+}
+
+// The fused pass from heights to finished vertices: every height is read once per row that
+// needs it, while it is still in cache, and every vertex written once
+static void writeGridVertexRows(float* vertices, int stride, int width, int length, const float* heightMap, const float* normals,
+    ThreadPool* pool)
+{
+    GridVertexJob job;
+    job.vertices = vertices;
+    job.packed = NULL;
+    job.heights = NULL;
+    job.packedNormals = NULL;
+    job.stride = stride;
+    job.width = width;
+    job.length = length;
+    job.heightMap = heightMap;
+    job.normals = normals;
+
+    runJobs(pool, writeGridVertexBand, &job, (length + VERTEX_BAND_ROWS - 1) / VERTEX_BAND_ROWS);
+}
+
+static void writeGridVertices(Mesh* mesh, const float* heightMap, const float* normals, ThreadPool* pool)
+{
+    writeGridVertexRows(mesh->vertices, MESH_VERTEX_FLOATS, mesh->gridWidth, mesh->vertexCount / mesh->gridWidth,
+        heightMap, normals, pool);
+}
+
+// Writes the packed vertices of a generatePlaneMesh grid anywhere, such as straight into a
+// mapped GPU buffer. normals may be NULL to derive them from the heights.
+void writeHeightMapPackedVertices(PackedVertex* vertices, int width, int length, float* heightMap, float* normals, ThreadPool* pool)
+{
+    GridVertexJob job;
+    job.vertices = NULL;
+    job.packed = vertices;
+    job.heights = NULL;
+    job.packedNormals = NULL;
+    job.stride = MESH_VERTEX_FLOATS;
+    job.width = width;
+    job.length = length;
+    job.heightMap = heightMap;
+    job.normals = normals;
+
+    runJobs(pool, writeGridVertexBand, &job, (length + VERTEX_BAND_ROWS - 1) / VERTEX_BAND_ROWS);
+}
+
+// Heights and octahedral packed normals, 2 snorm shorts per sample, for grids drawn from
+// textures. heightMapNormals may be NULL to derive them from the heights.
+void writeHeightMapTexels(float* heights, GLshort* normals, int width, int length, float* heightMap, float* heightMapNormals, ThreadPool* pool)
+{
+    GridVertexJob job;
+    job.vertices = NULL;
+    job.packed = NULL;
+    job.heights = heights;
+    job.packedNormals = normals;
+    job.stride = MESH_VERTEX_FLOATS;
+    job.width = width;
+    job.length = length;
+    job.heightMap = heightMap;
+    job.normals = heightMapNormals;
+
+    runJobs(pool, writeGridVertexBand, &job, (length + VERTEX_BAND_ROWS - 1) / VERTEX_BAND_ROWS);
+}
+
+// Packs the vertices of a generatePlaneMesh grid for upload
+void packMeshVertices(Mesh* mesh, PackedVertex* packed)
+{
+    for (int i = 0; i < mesh->vertexCount; i++)
+        packVertex(packed + i, mesh->vertices + i * MESH_VERTEX_FLOATS);
+}
+
+// Texels of a generatePlaneMesh grid, laid out like writeHeightMapTexels
+void packMeshTexels(Mesh* mesh, float* heights, GLshort* normals)
+{
+    for (int i = 0; i < mesh->vertexCount; i++) {
+        const float* vertex = mesh->vertices + i * MESH_VERTEX_FLOATS;
+        heights[i] = vertex[1];
+        packNormal(normals + i * 2, vertex + MESH_NORMAL_OFFSET);
+    }
+}
+
+// Plane meshes without a separate heightmap at hand, such as after translateMesh
+static float* copyGridHeights(Mesh* mesh)
+{
+    float* heightMap = (float*)malloc(mesh->vertexCount * sizeof(float));
+    if (heightMap == NULL)
+        return NULL;
+
+    for (int i = 0; i < mesh->vertexCount; i++)
+        heightMap[i] = mesh->vertices[i * MESH_VERTEX_FLOATS + 1];
+
+    return heightMap;
+}
+
 Mesh* updateNormals(Mesh* mesh)
+{
+    return updateNormalsParallel(mesh, NULL);
+}
+
+// generatePlaneMesh grids take their normals straight from the heights, bands run on the pool.
+// A NULL pool runs on the calling thread.
+Mesh* updateNormalsParallel(Mesh* mesh, ThreadPool* pool)
+{
+    if (mesh->gridWidth <= 0)
+        return updateFaceNormals(mesh);
+
+    float* heightMap = copyGridHeights(mesh);
+    if (heightMap == NULL)
+        return mesh;
+
+    writeGridVertices(mesh, heightMap, NULL, pool);
+    free(heightMap);
+
+    mesh->version++;
+
+    return mesh;
+}
+
+// Any triangle mesh: face normals accumulated onto their corners
+static Mesh* updateFaceNormals(Mesh* mesh)
 {
     // Initialize all normals to zero
-    memset(mesh->normals, 0, mesh->vertexCount * 3 * sizeof(GLfloat));
+    for (int i = 0; i < mesh->vertexCount; i++)
+        memset(mesh->vertices + i * MESH_VERTEX_FLOATS + MESH_NORMAL_OFFSET, 0, 3 * sizeof(GLfloat));
 
     // Accumulate face normals for each vertex
-    const faceCount = mesh->indexCount / 3;
+    const int faceCount = mesh->indexCount / 3;
     for (int i = 0; i < faceCount; i++) {
-        int indexA = mesh->indices[i * 3];
-        int indexB = mesh->indices[i * 3 + 1];
-        int indexC = mesh->indices[i * 3 + 2];
+        int faceIndices[3] = { mesh->indices[i * 3], mesh->indices[i * 3 + 1], mesh->indices[i * 3 + 2] };
 
-        float vecA[3] = { mesh->vertices[indexA * 5], mesh->vertices[indexA * 5 + 1], mesh->vertices[indexA * 5 + 2] };
-        float vecB[3] = { mesh->vertices[indexB * 5], mesh->vertices[indexB * 5 + 1], mesh->vertices[indexB * 5 + 2] };
-        float vecC[3] = { mesh->vertices[indexC * 5], mesh->vertices[indexC * 5 + 1], mesh->vertices[indexC * 5 + 2] };
+        float* vecA = &mesh->vertices[faceIndices[0] * MESH_VERTEX_FLOATS];
+        float* vecB = &mesh->vertices[faceIndices[1] * MESH_VERTEX_FLOATS];
+        float* vecC = &mesh->vertices[faceIndices[2] * MESH_VERTEX_FLOATS];
 
         float edge1[3] = { vecB[0] - vecA[0], vecB[1] - vecA[1], vecB[2] - vecA[2] };
         float edge2[3] = { vecC[0] - vecA[0], vecC[1] - vecA[1], vecC[2] - vecA[2] };
@@ -141,33 +484,44 @@ Mesh* updateNormals(Mesh* mesh)
         crossProduct(faceNormal, edge1, edge2);
         normalize(faceNormal);
 
-        mesh->normals[indexA * 3] += faceNormal[0];
-        mesh->normals[indexA * 3 + 1] += faceNormal[1];
-        mesh->normals[indexA * 3 + 2] += faceNormal[2];
-
-        mesh->normals[indexB * 3] += faceNormal[0];
-        mesh->normals[indexB * 3 + 1] += faceNormal[1];
-        mesh->normals[indexB * 3 + 2] += faceNormal[2];
-
-        mesh->normals[indexC * 3] += faceNormal[0];
-        mesh->normals[indexC * 3 + 1] += faceNormal[1];
-        mesh->normals[indexC * 3 + 2] += faceNormal[2];
+        for (int corner = 0; corner < 3; corner++) {
+            float* normal = &mesh->vertices[faceIndices[corner] * MESH_VERTEX_FLOATS + MESH_NORMAL_OFFSET];
+            normal[0] += faceNormal[0];
+            normal[1] += faceNormal[1];
+            normal[2] += faceNormal[2];
+        }
     }
 
     // Normalize the accumulated normals
     for (int i = 0; i < mesh->vertexCount; i++) {
-        normalize(&mesh->normals[i * 3]);
+        normalize(&mesh->vertices[i * MESH_VERTEX_FLOATS + MESH_NORMAL_OFFSET]);
     }
 
+    mesh->version++;
+
     return mesh;
 }
 
 Mesh* applyHeightMap(Mesh* mesh, float* heightMap)
 {
-    for (int i = 0; i < mesh->vertexCount; i++)
-        mesh->vertices[i * 5 + 1] = heightMap[i];
+    return applyHeightMapParallel(mesh, heightMap, NULL);
+}
 
-    updateNormals(mesh);
+// Plane meshes get heights and normals in one fused pass, anything else copies the heights
+// and accumulates face normals
+Mesh* applyHeightMapParallel(Mesh* mesh, float* heightMap, ThreadPool* pool)
+{
+    if (mesh->gridWidth <= 0) {
+        for (int i = 0; i < mesh->vertexCount; i++)
+            mesh->vertices[i * MESH_VERTEX_FLOATS + 1] = heightMap[i];
+
+        // updateNormals bumps the version, so the new heights get uploaded too
+        return updateFaceNormals(mesh);
+    }
+
+    writeGridVertices(mesh, heightMap, NULL, pool);
+
+    mesh->version++;
 
     return mesh;
 }
@@ -175,12 +529,19 @@ Mesh* applyHeightMap(Mesh* mesh, float* heightMap)
 Mesh* translateMesh(Mesh* mesh, float* offset)
 {
     for (int i = 0; i < mesh->vertexCount; i++) {
-        mesh->vertices[i * 5] = offset[0];
-        mesh->vertices[i * 5 + 1] = offset[1];
-        mesh->vertices[i * 5 + 2] = offset[2];
+        mesh->vertices[i * MESH_VERTEX_FLOATS] = offset[0];
+        mesh->vertices[i * MESH_VERTEX_FLOATS + 1] = offset[1];
+        mesh->vertices[i * MESH_VERTEX_FLOATS + 2] = offset[2];
     }
 
     updateNormals(mesh);
 
     return mesh;
+}
+
+void cleanMesh(Mesh* mesh)
+{
+    free(mesh->vertices);
+    free(mesh->indices);
+    free(mesh);
 }
\ No newline at end of file
@@ -2,15 +2,54 @@
 
 #include <GL/glew.h>
 
+#include "thread.h"
+
+// Interleaved float vertex layout: position, tex coord, normal
+#define MESH_VERTEX_FLOATS 8
+#define MESH_POSITION_OFFSET 0
+#define MESH_TEX_COORD_OFFSET 3
+#define MESH_NORMAL_OFFSET 5
+
+// Compact vertex of a generatePlaneMesh grid, 12 bytes in one stream. Tex coords follow from
+// the grid position, terrain.vert decodes the rest.
+typedef struct {
+	GLushort x;        // Grid column
+	GLushort z;        // Grid row
+	GLushort height;   // PACKED_HEIGHT_MIN + height * PACKED_HEIGHT_STEP
+	GLushort padding;
+	GLshort normal[2]; // Octahedral encoded around +y, snorm
+} PackedVertex;
+
+// Heights outside of the packed range are clamped
+#define PACKED_HEIGHT_MIN -512.0f
+#define PACKED_HEIGHT_STEP (1024.0f / 65535.0f)
+
+// How a mesh reaches the GPU
+typedef enum {
+	VERTEX_FORMAT_MESH,          // Mesh vertices as they are
+	VERTEX_FORMAT_PACKED,        // PackedVertex, a third of the size
+	VERTEX_FORMAT_HEIGHT_TEXTURE // No vertex buffer, a float height texture and a packed normal texture
+} VertexFormat;
+
 typedef struct {
-	GLfloat* vertices;
+	GLfloat* vertices; // MESH_VERTEX_FLOATS per vertex, NULL for a generateGridIndexMesh grid
 	int vertexCount;
 	GLint* indices;
 	int indexCount;
-	GLfloat* normals;
+	int version; // Bumped whenever vertices or normals change, renderers re-upload when it differs
+	int gridWidth; // Vertices per row of a generatePlaneMesh grid, normals come from the heights. 0 derives them from the faces.
 } Mesh;
 
 Mesh* generatePlaneMesh(int width, int length);
+Mesh* generateGridIndexMesh(int width, int length);
+Mesh* generateHeightMapMesh(int width, int length, float* heightMap, float* normals, ThreadPool* pool);
 Mesh* generateQuadMesh();
 Mesh* updateNormals(Mesh* mesh);
-Mesh* applyHeightMap(Mesh* mesh, float* heightMap);
\ No newline at end of file
+Mesh* updateNormalsParallel(Mesh* mesh, ThreadPool* pool);
+Mesh* applyHeightMap(Mesh* mesh, float* heightMap);
+Mesh* applyHeightMapParallel(Mesh* mesh, float* heightMap, ThreadPool* pool);
+void writeHeightMapPackedVertices(PackedVertex* vertices, int width, int length, float* heightMap, float* normals, ThreadPool* pool);
+void writeHeightMapTexels(float* heights, GLshort* normals, int width, int length, float* heightMap, float* heightMapNormals, ThreadPool* pool);
+void packMeshVertices(Mesh* mesh, PackedVertex* packed);
+void packMeshTexels(Mesh* mesh, float* heights, GLshort* normals);
+void cleanMesh(Mesh* mesh);
\ No newline at end of file
@@ -1,23 +1,91 @@
 
+#include "noise.h"
+
+#include <stdlib.h>
+#include <stdbool.h>
 #include <math.h>
+#include <limits.h>
+#include <immintrin.h>
+
+#include "simd.h"
+
+// Inlined even where the compiler's heuristics would keep a call, so constant arguments fold
+#ifdef _MSC_VER
+#define FORCE_INLINE __forceinline
+#else
+#define FORCE_INLINE inline __attribute__((always_inline))
+#endif
+
+#define HASH_ROW_PRIME 0x9E3779B1u
+#define HASH_COLUMN_PRIME 0x85EBCA77u
+
+// Murmur3's finalizer, every input bit affects every output bit
+static inline unsigned int mixHash(unsigned int h)
+{
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+    return h;
+}
+
+// Shuffles 0-255 with the seed, the second copy lets the column lookup skip its mask.
+// Returns NULL if the noise can't be allocated.
+Noise* createNoise(long seed, NoiseHash hash)
+{
+    Noise* noise = (Noise*)malloc(sizeof(Noise));
+    if (noise == NULL)
+        return NULL;
+
+    noise->seed = mixHash((unsigned int)seed);
+    noise->hash = hash;
+
+    for (int i = 0; i < 256; i++)
+        noise->permutation[i] = (unsigned char)i;
+
+    for (int i = 255; i > 0; i--) {
+        int j = mixHash(noise->seed + i * HASH_ROW_PRIME) % (i + 1);
+        unsigned char swap = noise->permutation[i];
+        noise->permutation[i] = noise->permutation[j];
+        noise->permutation[j] = swap;
+    }
+
+    for (int i = 0; i < 256 + 4; i++)
+        noise->permutation[256 + i] = noise->permutation[i & 255];
+
+    return noise;
+}
+
+void cleanNoise(Noise* noise)
+{
+    free(noise);
+}
+
+// Lattice values hash the row first and then the column within it, so a whole lattice
+// row shares the row part
+static inline int latticeRow(const Noise* noise, int row)
+{
+    if (noise->hash == NOISE_PERMUTATION)
+        return noise->permutation[row & 255];
+
+    return (int)mixHash(noise->seed ^ ((unsigned int)row * HASH_ROW_PRIME));
+}
+
+// 0 to 255 in both modes
+static inline int latticeValue(const Noise* noise, int rowHash, int column)
+{
+    if (noise->hash == NOISE_PERMUTATION)
+        return noise->permutation[rowHash + (column & 255)];
 
-static long hash[] = { 208,34,231,213,32,248,233,56,161,78,24,140,71,48,140,254,245,255,247,247,40,
-                     185,248,251,245,28,124,204,204,76,36,1,107,28,234,163,202,224,245,128,167,204,
-                     9,92,217,54,239,174,173,102,193,189,190,121,100,108,167,44,43,77,180,204,8,81,
-                     70,223,11,38,24,254,210,210,177,32,81,195,243,125,8,169,112,32,97,53,195,13,
-                     203,9,47,104,125,117,114,124,165,203,181,235,193,206,70,180,174,0,167,181,41,
-                     164,30,116,127,198,245,146,87,224,149,206,57,4,192,210,65,210,129,240,178,105,
-                     228,108,245,148,140,40,35,195,38,58,65,207,215,253,65,85,208,76,62,3,237,55,89,
-                     232,50,217,64,244,157,199,121,252,90,17,212,203,149,152,140,187,234,177,73,174,
-                     193,100,192,143,97,53,145,135,19,103,13,90,135,151,199,91,239,247,33,39,145,
-                     101,120,99,3,186,86,99,41,237,203,111,79,220,135,158,42,30,154,120,67,87,167,
-                     135,176,183,191,253,115,184,21,233,58,129,233,142,39,128,211,118,137,139,255,
-                     114,20,218,113,154,27,127,246,250,1,8,198,250,209,92,222,173,21,88,102,219 };
+    return (int)(mixHash((unsigned int)rowHash + (unsigned int)column * HASH_COLUMN_PRIME) >> 24);
+}
 
-long noise2(int x, int y, long seed)
+// Truncation rounds negative coordinates the wrong way
+static inline int floorToInt(float x)
 {
-    long tmp = hash[(y + seed) % 256];
-    return hash[(tmp + x) % 256];
+    int truncated = (int)x;
+    return truncated - (x < truncated);
 }
 
 float lin_inter(float x, float y, float s)
@@ -30,22 +98,24 @@ float smooth_inter(float x, float y, float s)
     return lin_inter(x, y, s * s * (3 - 2 * s));
 }
 
-float noise2d(float x, float y, long seed)
+float noise2d(float x, float y, const Noise* noise)
 {
-    int x_int = x;
-    int y_int = y;
+    int x_int = floorToInt(x);
+    int y_int = floorToInt(y);
     float x_frac = x - x_int;
     float y_frac = y - y_int;
-    int s = noise2(x_int, y_int, seed);
-    int t = noise2(x_int + 1, y_int, seed);
-    int u = noise2(x_int, y_int + 1, seed);
-    int v = noise2(x_int + 1, y_int + 1, seed);
+    int lowRow = latticeRow(noise, y_int);
+    int highRow = latticeRow(noise, y_int + 1);
+    int s = latticeValue(noise, lowRow, x_int);
+    int t = latticeValue(noise, lowRow, x_int + 1);
+    int u = latticeValue(noise, highRow, x_int);
+    int v = latticeValue(noise, highRow, x_int + 1);
     float low = smooth_inter(s, t, x_frac);
     float high = smooth_inter(u, v, x_frac);
     return smooth_inter(low, high, y_frac);
 }
 
-float perlin2d(float x, float y, long seed, float freq, int depth)
+float perlin2d(float x, float y, const Noise* noise, float freq, int depth)
 {
     float xa = x * freq;
     float ya = y * freq;
@@ -56,11 +126,616 @@ float perlin2d(float x, float y, long seed, float freq, int depth)
     for (int i = 0; i < depth; i++)
     {
         div += 256 * amp;
-        fin += noise2d(xa, ya, seed) * amp;
+        fin += noise2d(xa, ya, noise) * amp;
         amp /= 2;
         xa *= 2;
         ya *= 2;
     }
 
     return fin / div;
+}
+
+// Octaves whose wavelength, 1 / (freq * 2^octave) samples, is at least minWavelength samples.
+// Finer octaves can't be represented at that spacing and only alias. At least one is kept.
+int countResolvedOctaves(float freq, int depth, float minWavelength)
+{
+    int octaves = 1;
+    while (octaves < depth && freq * (float)(1 << octaves) * minWavelength <= 1.0f)
+        octaves++;
+
+    return octaves < depth ? octaves : depth;
+}
+
+// Share of the amplitude of a depth octave sum carried by its first octaves
+float octaveAmplitudeShare(int octaves, int depth)
+{
+    return (1.0f - ldexpf(1.0f, -octaves)) / (1.0f - ldexpf(1.0f, -depth));
+}
+
+// Unit gradients for gradient noise, picked by the low 3 bits of a lattice value
+static const float gradientX[8] = { 1.0f, -1.0f, 0.0f, 0.0f, 0.70710678f, -0.70710678f, 0.70710678f, -0.70710678f };
+static const float gradientY[8] = { 0.0f, 0.0f, 1.0f, -1.0f, 0.70710678f, 0.70710678f, -0.70710678f, -0.70710678f };
+
+// Gradient noise in about [-0.7, 0.7] with the quintic fade, which keeps the derivatives
+// continuous. derivative receives the partial derivatives along x and y.
+float gradientNoise2d(float x, float y, const Noise* noise, float* derivative)
+{
+    int xInt = floorToInt(x);
+    int yInt = floorToInt(y);
+    float fx = x - xInt;
+    float fy = y - yInt;
+
+    int lowRow = latticeRow(noise, yInt);
+    int highRow = latticeRow(noise, yInt + 1);
+    int a = latticeValue(noise, lowRow, xInt) & 7;
+    int b = latticeValue(noise, lowRow, xInt + 1) & 7;
+    int c = latticeValue(noise, highRow, xInt) & 7;
+    int d = latticeValue(noise, highRow, xInt + 1) & 7;
+
+    // Each corner's gradient dotted with the offset to the sample
+    float va = gradientX[a] * fx + gradientY[a] * fy;
+    float vb = gradientX[b] * (fx - 1) + gradientY[b] * fy;
+    float vc = gradientX[c] * fx + gradientY[c] * (fy - 1);
+    float vd = gradientX[d] * (fx - 1) + gradientY[d] * (fy - 1);
+
+    float ux = fx * fx * fx * (fx * (fx * 6 - 15) + 10);
+    float uy = fy * fy * fy * (fy * (fy * 6 - 15) + 10);
+    float dux = 30 * fx * fx * (fx * (fx - 2) + 1);
+    float duy = 30 * fy * fy * (fy * (fy - 2) + 1);
+
+    float cross = va - vb - vc + vd;
+
+    derivative[0] = gradientX[a] + ux * (gradientX[b] - gradientX[a]) + uy * (gradientX[c] - gradientX[a])
+        + ux * uy * (gradientX[a] - gradientX[b] - gradientX[c] + gradientX[d]) + dux * (vb - va + uy * cross);
+    derivative[1] = gradientY[a] + ux * (gradientY[b] - gradientY[a]) + uy * (gradientY[c] - gradientY[a])
+        + ux * uy * (gradientY[a] - gradientY[b] - gradientY[c] + gradientY[d]) + duy * (vc - va + ux * cross);
+
+    return va + ux * (vb - va) + uy * (vc - va) + ux * uy * cross;
+}
+
+// Octaves of gradient noise summed like perlin2d and centred on 0.5 so heights land in the
+// same range. derivative receives d/dx and d/dy of the result in sample units, which is
+// everything a surface normal needs without sampling the neighbours.
+float gradient2d(float x, float y, const Noise* noise, float freq, int depth, float* derivative)
+{
+    float xa = x * freq;
+    float ya = y * freq;
+    float amp = 1.0f;
+    float scale = freq; // Chain rule factor of the current octave
+    float fin = 0.0f;
+    float dx = 0.0f;
+    float dy = 0.0f;
+    float div = 0.0f;
+
+    for (int i = 0; i < depth; i++) {
+        float octave[2];
+        fin += gradientNoise2d(xa, ya, noise, octave) * amp;
+        dx += octave[0] * amp * scale;
+        dy += octave[1] * amp * scale;
+        div += amp;
+        amp /= 2;
+        scale *= 2;
+        xa *= 2;
+        ya *= 2;
+    }
+
+    derivative[0] = 0.5f * dx / div;
+    derivative[1] = 0.5f * dy / div;
+    return 0.5f + 0.5f * fin / div;
+}
+
+TARGET_AVX2 static inline __m256 smoothInterAvx2(__m256 x, __m256 y, __m256 s)
+{
+    __m256 t = _mm256_mul_ps(_mm256_mul_ps(s, s), _mm256_sub_ps(_mm256_set1_ps(3.0f), _mm256_mul_ps(_mm256_set1_ps(2.0f), s)));
+    return _mm256_add_ps(x, _mm256_mul_ps(t, _mm256_sub_ps(y, x)));
+}
+
+TARGET_AVX2 static inline __m256i mixHashAvx2(__m256i h)
+{
+    h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 16));
+    h = _mm256_mullo_epi32(h, _mm256_set1_epi32((int)0x85EBCA6Bu));
+    h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 13));
+    h = _mm256_mullo_epi32(h, _mm256_set1_epi32((int)0xC2B2AE35u));
+    return _mm256_xor_si256(h, _mm256_srli_epi32(h, 16));
+}
+
+// The permutation is gathered 4 bytes at a time, the padding keeps the last entries in bounds
+TARGET_AVX2 static inline __m256i gatherPermutationAvx2(const Noise* noise, __m256i index)
+{
+    return _mm256_and_si256(_mm256_i32gather_epi32((const int*)noise->permutation, index, 1), _mm256_set1_epi32(255));
+}
+
+TARGET_AVX2 static inline __m256i latticeRowAvx2(const Noise* noise, __m256i row)
+{
+    if (noise->hash == NOISE_PERMUTATION)
+        return gatherPermutationAvx2(noise, _mm256_and_si256(row, _mm256_set1_epi32(255)));
+
+    return mixHashAvx2(_mm256_xor_si256(_mm256_set1_epi32((int)noise->seed), _mm256_mullo_epi32(row, _mm256_set1_epi32((int)HASH_ROW_PRIME))));
+}
+
+TARGET_AVX2 static inline __m256i latticeValueEpi32Avx2(const Noise* noise, __m256i rowHash, __m256i column)
+{
+    if (noise->hash == NOISE_PERMUTATION)
+        return gatherPermutationAvx2(noise, _mm256_add_epi32(rowHash, _mm256_and_si256(column, _mm256_set1_epi32(255))));
+
+    __m256i h = _mm256_add_epi32(rowHash, _mm256_mullo_epi32(column, _mm256_set1_epi32((int)HASH_COLUMN_PRIME)));
+    return _mm256_srli_epi32(mixHashAvx2(h), 24);
+}
+
+TARGET_AVX2 static inline __m256 latticeValueAvx2(const Noise* noise, __m256i rowHash, __m256i column)
+{
+    return _mm256_cvtepi32_ps(latticeValueEpi32Avx2(noise, rowHash, column));
+}
+
+// noise2d for 8 points, operation for operation
+TARGET_AVX2 static inline __m256 valueNoiseAvx2(const Noise* noise, __m256 xa, __m256 ya)
+{
+    const __m256i one = _mm256_set1_epi32(1);
+
+    __m256i xInt = _mm256_cvttps_epi32(_mm256_floor_ps(xa));
+    __m256i yInt = _mm256_cvttps_epi32(_mm256_floor_ps(ya));
+    __m256 xFrac = _mm256_sub_ps(xa, _mm256_cvtepi32_ps(xInt));
+    __m256 yFrac = _mm256_sub_ps(ya, _mm256_cvtepi32_ps(yInt));
+
+    __m256i rowLow = latticeRowAvx2(noise, yInt);
+    __m256i rowHigh = latticeRowAvx2(noise, _mm256_add_epi32(yInt, one));
+    __m256i xNext = _mm256_add_epi32(xInt, one);
+
+    __m256 s = latticeValueAvx2(noise, rowLow, xInt);
+    __m256 t = latticeValueAvx2(noise, rowLow, xNext);
+    __m256 u = latticeValueAvx2(noise, rowHigh, xInt);
+    __m256 v = latticeValueAvx2(noise, rowHigh, xNext);
+
+    __m256 low = smoothInterAvx2(s, t, xFrac);
+    __m256 high = smoothInterAvx2(u, v, xFrac);
+    return smoothInterAvx2(low, high, yFrac);
+}
+
+// Corner gradient dotted with the offset to the sample, the gradient tables fit in one register each
+TARGET_AVX2 static inline __m256 cornerDotAvx2(__m256i corner, __m256 fx, __m256 fy, __m256* gx, __m256* gy)
+{
+    *gx = _mm256_permutevar8x32_ps(_mm256_loadu_ps(gradientX), corner);
+    *gy = _mm256_permutevar8x32_ps(_mm256_loadu_ps(gradientY), corner);
+    return _mm256_add_ps(_mm256_mul_ps(*gx, fx), _mm256_mul_ps(*gy, fy));
+}
+
+// quintic(f) = f^3 (f (6f - 15) + 10), its derivative is 30 f^2 (f (f - 2) + 1)
+TARGET_AVX2 static inline __m256 quinticAvx2(__m256 f, __m256* derivative)
+{
+    __m256 f2 = _mm256_mul_ps(f, f);
+    *derivative = _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(30.0f), f), f),
+        _mm256_add_ps(_mm256_mul_ps(f, _mm256_sub_ps(f, _mm256_set1_ps(2.0f))), _mm256_set1_ps(1.0f)));
+    return _mm256_mul_ps(_mm256_mul_ps(f2, f),
+        _mm256_add_ps(_mm256_mul_ps(f, _mm256_sub_ps(_mm256_mul_ps(f, _mm256_set1_ps(6.0f)), _mm256_set1_ps(15.0f))), _mm256_set1_ps(10.0f)));
+}
+
+// a + ux (b - a) + uy (c - a) + ux uy cross, the bilinear form shared by the value and both derivatives
+TARGET_AVX2 static inline __m256 blendCornersAvx2(__m256 a, __m256 b, __m256 c, __m256 cross, __m256 ux, __m256 uy)
+{
+    return _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(a, _mm256_mul_ps(ux, _mm256_sub_ps(b, a))), _mm256_mul_ps(uy, _mm256_sub_ps(c, a))),
+        _mm256_mul_ps(_mm256_mul_ps(ux, uy), cross));
+}
+
+// gradientNoise2d for 8 points, operation for operation
+TARGET_AVX2 static inline __m256 gradientNoiseAvx2(const Noise* noise, __m256 xa, __m256 ya, __m256* derivativeX, __m256* derivativeY)
+{
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i cornerMask = _mm256_set1_epi32(7);
+    const __m256 oneF = _mm256_set1_ps(1.0f);
+
+    __m256i xInt = _mm256_cvttps_epi32(_mm256_floor_ps(xa));
+    __m256i yInt = _mm256_cvttps_epi32(_mm256_floor_ps(ya));
+    __m256 fx = _mm256_sub_ps(xa, _mm256_cvtepi32_ps(xInt));
+    __m256 fy = _mm256_sub_ps(ya, _mm256_cvtepi32_ps(yInt));
+    __m256 fx1 = _mm256_sub_ps(fx, oneF);
+    __m256 fy1 = _mm256_sub_ps(fy, oneF);
+
+    __m256i lowRow = latticeRowAvx2(noise, yInt);
+    __m256i highRow = latticeRowAvx2(noise, _mm256_add_epi32(yInt, one));
+    __m256i xNext = _mm256_add_epi32(xInt, one);
+
+    __m256 gxa, gya, gxb, gyb, gxc, gyc, gxd, gyd;
+    __m256 va = cornerDotAvx2(_mm256_and_si256(latticeValueEpi32Avx2(noise, lowRow, xInt), cornerMask), fx, fy, &gxa, &gya);
+    __m256 vb = cornerDotAvx2(_mm256_and_si256(latticeValueEpi32Avx2(noise, lowRow, xNext), cornerMask), fx1, fy, &gxb, &gyb);
+    __m256 vc = cornerDotAvx2(_mm256_and_si256(latticeValueEpi32Avx2(noise, highRow, xInt), cornerMask), fx, fy1, &gxc, &gyc);
+    __m256 vd = cornerDotAvx2(_mm256_and_si256(latticeValueEpi32Avx2(noise, highRow, xNext), cornerMask), fx1, fy1, &gxd, &gyd);
+
+    __m256 dux, duy;
+    __m256 ux = quinticAvx2(fx, &dux);
+    __m256 uy = quinticAvx2(fy, &duy);
+
+    __m256 cross = _mm256_add_ps(_mm256_sub_ps(_mm256_sub_ps(va, vb), vc), vd);
+    __m256 crossX = _mm256_add_ps(_mm256_sub_ps(_mm256_sub_ps(gxa, gxb), gxc), gxd);
+    __m256 crossY = _mm256_add_ps(_mm256_sub_ps(_mm256_sub_ps(gya, gyb), gyc), gyd);
+
+    *derivativeX = _mm256_add_ps(blendCornersAvx2(gxa, gxb, gxc, crossX, ux, uy),
+        _mm256_mul_ps(dux, _mm256_add_ps(_mm256_sub_ps(vb, va), _mm256_mul_ps(uy, cross))));
+    *derivativeY = _mm256_add_ps(blendCornersAvx2(gya, gyb, gyc, crossY, ux, uy),
+        _mm256_mul_ps(duy, _mm256_add_ps(_mm256_sub_ps(vc, va), _mm256_mul_ps(ux, cross))));
+    return blendCornersAvx2(va, vb, vc, cross, ux, uy);
+}
+
+// 8 samples of gradient2d at once, operation for operation the scalar code
+TARGET_AVX2 static void gradient2dRowAvx2(float* out, float* dx, float* dy, int count, int x, int y, const Noise* noise, float freq, int depth)
+{
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 xa = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(x + i), lanes)), _mm256_set1_ps(freq));
+        __m256 ya = _mm256_set1_ps((float)y * freq);
+        float amp = 1.0f;
+        float scale = freq;
+        __m256 fin = _mm256_setzero_ps();
+        __m256 sumX = _mm256_setzero_ps();
+        __m256 sumY = _mm256_setzero_ps();
+        float div = 0.0f;
+
+        for (int octave = 0; octave < depth; octave++) {
+            __m256 noiseX, noiseY;
+            __m256 value = gradientNoiseAvx2(noise, xa, ya, &noiseX, &noiseY);
+
+            __m256 amplitude = _mm256_set1_ps(amp);
+            fin = _mm256_add_ps(fin, _mm256_mul_ps(value, amplitude));
+            sumX = _mm256_add_ps(sumX, _mm256_mul_ps(_mm256_mul_ps(noiseX, amplitude), _mm256_set1_ps(scale)));
+            sumY = _mm256_add_ps(sumY, _mm256_mul_ps(_mm256_mul_ps(noiseY, amplitude), _mm256_set1_ps(scale)));
+            div += amp;
+            amp /= 2;
+            scale *= 2;
+            xa = _mm256_mul_ps(xa, _mm256_set1_ps(2.0f));
+            ya = _mm256_mul_ps(ya, _mm256_set1_ps(2.0f));
+        }
+
+        const __m256 half = _mm256_set1_ps(0.5f);
+        const __m256 divisor = _mm256_set1_ps(div);
+        _mm256_storeu_ps(dx + i, _mm256_div_ps(_mm256_mul_ps(half, sumX), divisor));
+        _mm256_storeu_ps(dy + i, _mm256_div_ps(_mm256_mul_ps(half, sumY), divisor));
+        _mm256_storeu_ps(out + i, _mm256_add_ps(half, _mm256_div_ps(_mm256_mul_ps(half, fin), divisor)));
+    }
+
+    for (; i < count; i++) {
+        float derivative[2];
+        out[i] = gradient2d((float)(x + i), (float)y, noise, freq, depth, derivative);
+        dx[i] = derivative[0];
+        dy[i] = derivative[1];
+    }
+}
+
+// Evaluates gradient2d at (x + i, y) for every i in [0, count), dx and dy receive the derivatives
+void gradient2dRow(float* out, float* dx, float* dy, int count, int x, int y, const Noise* noise, float freq, int depth)
+{
+    if (cpuHasAvx2()) {
+        gradient2dRowAvx2(out, dx, dy, count, x, y, noise, freq, depth);
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        float derivative[2];
+        out[i] = gradient2d((float)(x + i), (float)y, noise, freq, depth, derivative);
+        dx[i] = derivative[0];
+        dy[i] = derivative[1];
+    }
+}
+
+TARGET_AVX2 static void valueNoisePointsAvx2(float* out, const float* x, const float* y, int count, const Noise* noise)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+        _mm256_storeu_ps(out + i, valueNoiseAvx2(noise, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i)));
+
+    for (; i < count; i++)
+        out[i] = noise2d(x[i], y[i], noise);
+}
+
+// noise2d at every (x[i], y[i]), for evaluators whose coordinates don't lie on a grid
+void valueNoisePoints(float* out, const float* x, const float* y, int count, const Noise* noise)
+{
+    if (cpuHasAvx2()) {
+        valueNoisePointsAvx2(out, x, y, count, noise);
+        return;
+    }
+
+    for (int i = 0; i < count; i++)
+        out[i] = noise2d(x[i], y[i], noise);
+}
+
+TARGET_AVX2 static void gradientNoisePointsAvx2(float* out, const float* x, const float* y, int count, const Noise* noise)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 unusedX, unusedY;
+        _mm256_storeu_ps(out + i, gradientNoiseAvx2(noise, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i), &unusedX, &unusedY));
+    }
+
+    for (; i < count; i++) {
+        float unused[2];
+        out[i] = gradientNoise2d(x[i], y[i], noise, unused);
+    }
+}
+
+// gradientNoise2d at every (x[i], y[i]) without the derivatives
+void gradientNoisePoints(float* out, const float* x, const float* y, int count, const Noise* noise)
+{
+    if (cpuHasAvx2()) {
+        gradientNoisePointsAvx2(out, x, y, count, noise);
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        float unused[2];
+        out[i] = gradientNoise2d(x[i], y[i], noise, unused);
+    }
+}
+
+typedef struct {
+    int* xInt;          // Lattice column left of every sample
+    float* xFrac;       // Position of every sample between its two lattice columns
+    int latticeStart;   // First lattice column any sample of the tile touches
+    int latticeCount;
+    int rows[2];        // Lattice rows held in values, INT_MIN when empty
+    float* values[2];   // A lattice row interpolated along x at every sample
+} OctaveCache;
+
+// Interpolates one lattice row along x at every sample column. Sparse octaves hash each
+// lattice point once, octaves with more lattice points than samples look up only what they use.
+static void interpolateLatticeRow(OctaveCache* cache, int slot, int row, const Noise* noise, int width, float* lattice)
+{
+    int rowHash = latticeRow(noise, row);
+    const int* xInt = cache->xInt;
+    const float* xFrac = cache->xFrac;
+    float* values = cache->values[slot];
+
+    if (cache->latticeCount > width) {
+        for (int x = 0; x < width; x++)
+            values[x] = smooth_inter((float)latticeValue(noise, rowHash, xInt[x]), (float)latticeValue(noise, rowHash, xInt[x] + 1), xFrac[x]);
+    }
+    else {
+        for (int i = 0; i < cache->latticeCount; i++)
+            lattice[i] = (float)latticeValue(noise, rowHash, cache->latticeStart + i);
+
+        for (int x = 0; x < width; x++) {
+            int i = xInt[x] - cache->latticeStart;
+            values[x] = smooth_inter(lattice[i], lattice[i + 1], xFrac[x]);
+        }
+    }
+
+    cache->rows[slot] = row;
+}
+
+TARGET_AVX2 static void interpolateLatticeRowAvx2(OctaveCache* cache, int slot, int row, const Noise* noise, int width, float* lattice)
+{
+    int rowHash = latticeRow(noise, row);
+    const int* xInt = cache->xInt;
+    const float* xFrac = cache->xFrac;
+    float* values = cache->values[slot];
+    bool dense = cache->latticeCount > width;
+
+    if (!dense) {
+        for (int i = 0; i < cache->latticeCount; i++)
+            lattice[i] = (float)latticeValue(noise, rowHash, cache->latticeStart + i);
+    }
+
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i rowHashes = _mm256_set1_epi32(rowHash);
+    const __m256i latticeStart = _mm256_set1_epi32(cache->latticeStart);
+
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m256i column = _mm256_loadu_si256((const __m256i*)(xInt + x));
+        __m256 left, right;
+        if (dense) {
+            left = latticeValueAvx2(noise, rowHashes, column);
+            right = latticeValueAvx2(noise, rowHashes, _mm256_add_epi32(column, one));
+        }
+        else {
+            __m256i index = _mm256_sub_epi32(column, latticeStart);
+            left = _mm256_i32gather_ps(lattice, index, 4);
+            right = _mm256_i32gather_ps(lattice, _mm256_add_epi32(index, one), 4);
+        }
+        _mm256_storeu_ps(values + x, smoothInterAvx2(left, right, _mm256_loadu_ps(xFrac + x)));
+    }
+
+    for (; x < width; x++) {
+        if (dense)
+            values[x] = smooth_inter((float)latticeValue(noise, rowHash, xInt[x]), (float)latticeValue(noise, rowHash, xInt[x] + 1), xFrac[x]);
+        else
+            values[x] = smooth_inter(lattice[xInt[x] - cache->latticeStart], lattice[xInt[x] - cache->latticeStart + 1], xFrac[x]);
+    }
+
+    cache->rows[slot] = row;
+}
+
+// row = row * keep + interpolate(low, high, yFrac) * amp, keep is 0 for the first octave
+TARGET_AVX2 static void accumulateOctaveAvx2(float* row, const float* low, const float* high, float yFrac, float amp, bool first, int width)
+{
+    const __m256 fraction = _mm256_set1_ps(yFrac);
+    const __m256 amplitude = _mm256_set1_ps(amp);
+
+    int i = 0;
+    for (; i + 8 <= width; i += 8) {
+        __m256 noise = _mm256_mul_ps(smoothInterAvx2(_mm256_loadu_ps(low + i), _mm256_loadu_ps(high + i), fraction), amplitude);
+        _mm256_storeu_ps(row + i, first ? noise : _mm256_add_ps(_mm256_loadu_ps(row + i), noise));
+    }
+
+    for (; i < width; i++) {
+        float noise = smooth_inter(low[i], high[i], yFrac) * amp;
+        row[i] = first ? noise : row[i] + noise;
+    }
+}
+
+// Fills the tile row by row from the prepared octave caches. Inlined into the kernels below with
+// depth as a constant, so the octave loop unrolls and the normalization folds into a constant.
+static FORCE_INLINE void fillTileRows(OctaveCache* caches, float* lattice, float* out, int width, int height, int y,
+    const Noise* noise, float freq, int depth, bool useAvx2)
+{
+    // The sum perlin2d builds per sample, every term is exact in float
+    float div = 0.0f;
+    float octaveAmp = 1.0f;
+    for (int octave = 0; octave < depth; octave++) {
+        div += 256 * octaveAmp;
+        octaveAmp /= 2;
+    }
+
+    for (int j = 0; j < height; j++) {
+        float* row = out + j * width;
+        float ya = (float)(y + j) * freq;
+        float amp = 1.0;
+
+        for (int octave = 0; octave < depth; octave++) {
+            OctaveCache* cache = &caches[octave];
+            int yInt = floorToInt(ya);
+            float yFrac = ya - yInt;
+
+            // Rows move forward, so the upper row of the last sample row often becomes the lower one
+            int lowSlot = cache->rows[0] == yInt ? 0 : (cache->rows[1] == yInt ? 1 : -1);
+            if (lowSlot == -1) {
+                lowSlot = cache->rows[0] == yInt + 1 ? 1 : 0;
+                if (useAvx2)
+                    interpolateLatticeRowAvx2(cache, lowSlot, yInt, noise, width, lattice);
+                else
+                    interpolateLatticeRow(cache, lowSlot, yInt, noise, width, lattice);
+            }
+            int highSlot = 1 - lowSlot;
+            if (cache->rows[highSlot] != yInt + 1) {
+                if (useAvx2)
+                    interpolateLatticeRowAvx2(cache, highSlot, yInt + 1, noise, width, lattice);
+                else
+                    interpolateLatticeRow(cache, highSlot, yInt + 1, noise, width, lattice);
+            }
+
+            const float* low = cache->values[lowSlot];
+            const float* high = cache->values[highSlot];
+
+            if (useAvx2) {
+                accumulateOctaveAvx2(row, low, high, yFrac, amp, octave == 0, width);
+            }
+            else if (octave == 0) {
+                for (int i = 0; i < width; i++)
+                    row[i] = smooth_inter(low[i], high[i], yFrac) * amp;
+            }
+            else {
+                for (int i = 0; i < width; i++)
+                    row[i] += smooth_inter(low[i], high[i], yFrac) * amp;
+            }
+
+            amp /= 2;
+            ya *= 2;
+        }
+
+        for (int i = 0; i < width; i++)
+            row[i] /= div;
+    }
+}
+
+static void fillTileRowsGeneric(OctaveCache* caches, float* lattice, float* out, int width, int height, int y,
+    const Noise* noise, float freq, int depth, bool useAvx2)
+{
+    fillTileRows(caches, lattice, out, width, height, y, noise, freq, depth, useAvx2);
+}
+
+#define DEFINE_TILE_KERNEL(depth) \
+static void fillTileRowsDepth##depth(OctaveCache* caches, float* lattice, float* out, int width, int height, int y, \
+    const Noise* noise, float freq, bool useAvx2) \
+{ \
+    fillTileRows(caches, lattice, out, width, height, y, noise, freq, depth, useAvx2); \
+}
+
+DEFINE_TILE_KERNEL(4)
+DEFINE_TILE_KERNEL(6)
+DEFINE_TILE_KERNEL(8)
+DEFINE_TILE_KERNEL(10)
+DEFINE_TILE_KERNEL(12)
+
+typedef void (*TileKernel)(OctaveCache* caches, float* lattice, float* out, int width, int height, int y,
+    const Noise* noise, float freq, bool useAvx2);
+
+// Indexed by octave count, counts without a kernel use the generic loop. Building with
+// NOISE_GENERIC_TILES sends every count there, which is what benchmarks/noise.c compares against.
+static const TileKernel tileKernels[] = {
+    NULL, NULL, NULL, NULL,
+    fillTileRowsDepth4, NULL,
+    fillTileRowsDepth6, NULL,
+    fillTileRowsDepth8, NULL,
+    fillTileRowsDepth10, NULL,
+    fillTileRowsDepth12
+};
+
+#define TILE_KERNEL_COUNT (int)(sizeof(tileKernels) / sizeof(tileKernels[0]))
+
+// The tile one sample at a time, needs no memory when the caches can't be allocated
+static void perlin2dSamples(float* out, int width, int height, int x, int y, const Noise* noise, float freq, int depth)
+{
+    for (int j = 0; j < height; j++)
+        for (int i = 0; i < width; i++)
+            out[j * width + i] = perlin2d((float)(x + i), (float)(y + j), noise, freq, depth);
+}
+
+// Evaluates perlin2d at (x + i, y + j) for a width by height tile, out is row major.
+// Each octave keeps the lattice rows around the current sample row interpolated along x,
+// so a sample only costs one interpolation along y per octave and lattice values are
+// hashed once per lattice point instead of four times per sample. The arithmetic is the
+// scalar code's, so the results are bit-identical to perlin2d.
+void perlin2dTile(float* out, int width, int height, int x, int y, const Noise* noise, float freq, int depth)
+{
+    bool useAvx2 = cpuHasAvx2();
+    OctaveCache* caches = (OctaveCache*)malloc(depth * sizeof(OctaveCache));
+    int* xInts = (int*)malloc(depth * width * sizeof(int));
+    float* floats = (float*)malloc(depth * width * 3 * sizeof(float));
+    if (caches == NULL || xInts == NULL || floats == NULL) {
+        free(floats);
+        free(xInts);
+        free(caches);
+        perlin2dSamples(out, width, height, x, y, noise, freq, depth);
+        return;
+    }
+
+    int latticeCapacity = 0;
+    for (int octave = 0; octave < depth; octave++) {
+        OctaveCache* cache = &caches[octave];
+        cache->xInt = xInts + octave * width;
+        cache->xFrac = floats + octave * width * 3;
+        cache->values[0] = cache->xFrac + width;
+        cache->values[1] = cache->xFrac + width * 2;
+        cache->rows[0] = INT_MIN;
+        cache->rows[1] = INT_MIN;
+
+        // Same sequence of roundings as perlin2d: scale by freq, then double per octave
+        for (int i = 0; i < width; i++) {
+            float xa = (float)(x + i) * freq;
+            for (int o = 0; o < octave; o++)
+                xa *= 2;
+            cache->xInt[i] = floorToInt(xa);
+            cache->xFrac[i] = xa - cache->xInt[i];
+        }
+
+        cache->latticeStart = cache->xInt[0];
+        cache->latticeCount = cache->xInt[width - 1] - cache->latticeStart + 2;
+        if (cache->latticeCount <= width && cache->latticeCount > latticeCapacity)
+            latticeCapacity = cache->latticeCount;
+    }
+
+    float* lattice = (float*)malloc(latticeCapacity * sizeof(float));
+    if (lattice == NULL && latticeCapacity > 0) {
+        free(floats);
+        free(xInts);
+        free(caches);
+        perlin2dSamples(out, width, height, x, y, noise, freq, depth);
+        return;
+    }
+
+#ifdef NOISE_GENERIC_TILES
+    TileKernel kernel = NULL;
+#else
+    TileKernel kernel = depth >= 0 && depth < TILE_KERNEL_COUNT ? tileKernels[depth] : NULL;
+#endif
+
+    if (kernel != NULL)
+        kernel(caches, lattice, out, width, height, y, noise, freq, useAvx2);
+    else
+        fillTileRowsGeneric(caches, lattice, out, width, height, y, noise, freq, depth, useAvx2);
+
+    free(lattice);
+    free(floats);
+    free(xInts);
+    free(caches);
 }
\ No newline at end of file
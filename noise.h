@@ -1,3 +1,27 @@
 #pragma once
 
-float perlin2d(float x, float y, long seed, float freq, int depth);
\ No newline at end of file
+typedef enum {
+	NOISE_PERMUTATION,  // Seed shuffled table, repeats every 256 lattice units
+	NOISE_INTEGER_HASH  // Hashes the lattice coordinates, never repeats
+} NoiseHash;
+
+// Everything a seed expands into. Small enough to stay in L1 next to the noise loops.
+typedef struct {
+	unsigned char permutation[512 + 4]; // Two copies of a shuffle of 0-255, padded for 32-bit gathers
+	unsigned int seed;                  // Mixed seed for NOISE_INTEGER_HASH
+	NoiseHash hash;
+} Noise;
+
+Noise* createNoise(long seed, NoiseHash hash);
+void cleanNoise(Noise* noise);
+
+int countResolvedOctaves(float freq, int depth, float minWavelength);
+float octaveAmplitudeShare(int octaves, int depth);
+
+float perlin2d(float x, float y, const Noise* noise, float freq, int depth);
+void perlin2dTile(float* out, int width, int height, int x, int y, const Noise* noise, float freq, int depth);
+void valueNoisePoints(float* out, const float* x, const float* y, int count, const Noise* noise);
+void gradientNoisePoints(float* out, const float* x, const float* y, int count, const Noise* noise);
+float gradientNoise2d(float x, float y, const Noise* noise, float* derivative);
+float gradient2d(float x, float y, const Noise* noise, float freq, int depth, float* derivative);
+void gradient2dRow(float* out, float* dx, float* dy, int count, int x, int y, const Noise* noise, float freq, int depth);
\ No newline at end of file
@@ -0,0 +1,735 @@
+#include "noisegraph.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+
+// Graphs are compiled into a linear program over registers of one tile of samples each.
+// A tile's registers stay in L1/L2 while every instruction streams through them, so no
+// intermediate ever becomes a full heightmap sized buffer.
+
+// Samples per tile, 4 KB per register
+#define NOISE_GRAPH_TILE_WIDTH 64
+#define NOISE_GRAPH_TILE_HEIGHT 16
+#define NOISE_GRAPH_TILE_SIZE (NOISE_GRAPH_TILE_WIDTH * NOISE_GRAPH_TILE_HEIGHT)
+
+// Rows of tiles that share one perlin2dTile call per unwarped fbm node. Its lattice row caches
+// take a while to pay off, so a call should span far more than one tile.
+#define NOISE_GRAPH_BAND_HEIGHT (NOISE_GRAPH_TILE_HEIGHT * 2)
+
+// Octaves with fewer samples than this per wavelength are skipped, 2 is the Nyquist limit
+#define NOISE_GRAPH_MIN_WAVELENGTH 2.0f
+
+// Average output of an octave of each kind, stands in for octaves culled at coarse spacings
+#define VALUE_OCTAVE_MEAN (127.5f / 256.0f)
+#define RIDGED_OCTAVE_MEAN 0.59f
+#define BILLOW_OCTAVE_MEAN 0.25f
+
+// Gradient noise stays within about [-1 / sqrt(2), 1 / sqrt(2)]
+#define GRADIENT_NOISE_SCALE 1.41421356f
+
+#define NOISE_CURVE_MAX_POINTS 8
+
+typedef enum {
+    NOISE_NODE_FBM,
+    NOISE_NODE_RIDGED,
+    NOISE_NODE_BILLOW,
+    NOISE_NODE_WARP,
+    NOISE_NODE_ADD,
+    NOISE_NODE_MUL,
+    NOISE_NODE_BLEND,
+    NOISE_NODE_CLAMP,
+    NOISE_NODE_CURVE,
+    NOISE_NODE_CONSTANT
+} NoiseNodeType;
+
+typedef struct {
+    NoiseNodeType type;
+    int inputs[3];          // Node indices, -1 when unused
+    float frequency;        // Per world unit, octave nodes only
+    int depth;
+    float parameters[2];    // Warp strength, clamp bounds or the constant
+    int pointCount;         // Curve control points as x, y pairs with ascending x
+    float points[NOISE_CURVE_MAX_POINTS * 2];
+} NoiseNode;
+
+typedef enum {
+    NOISE_OP_OCTAVES,   // Octave node at the coordinates in sources 0 and 1
+    NOISE_OP_DISPLACE,  // Coordinate in source 0 moved by (source 1 - 0.5) * strength
+    NOISE_OP_ADD,
+    NOISE_OP_MUL,
+    NOISE_OP_BLEND,
+    NOISE_OP_CLAMP,
+    NOISE_OP_CURVE,
+    NOISE_OP_CONSTANT
+} NoiseOp;
+
+typedef struct {
+    NoiseOp op;
+    int target;
+    int sources[3];
+    int node;           // Where the parameters come from
+    int band;           // Band buffer of an unwarped fbm node, -1 for everything else
+} NoiseInstruction;
+
+// Registers 0 and 1 always hold the world coordinates of the tile's samples
+#define NOISE_REGISTER_X 0
+#define NOISE_REGISTER_Y 1
+
+struct NoiseGraph {
+    const Noise* noise;
+    NoiseNode* nodes;
+    int nodeCount;
+    int nodeCapacity;
+    NoiseInstruction* program;
+    int instructionCount;
+    int registerCount;
+    int bandCount;          // Unwarped fbm instructions, each evaluated a band at a time
+    bool readsCoordinates;  // Whether any other instruction reads the coordinate registers
+    int outputRegister;     // -1 until compiled
+};
+
+NoiseGraph* createNoiseGraph(const Noise* noise)
+{
+    NoiseGraph* graph = (NoiseGraph*)malloc(sizeof(NoiseGraph));
+    if (graph == NULL)
+        return NULL;
+
+    graph->noise = noise;
+    graph->nodes = NULL;
+    graph->nodeCount = 0;
+    graph->nodeCapacity = 0;
+    graph->program = NULL;
+    graph->instructionCount = 0;
+    graph->registerCount = 0;
+    graph->bandCount = 0;
+    graph->readsCoordinates = false;
+    graph->outputRegister = -1;
+
+    return graph;
+}
+
+// Returns the new node's index, or -1 when an input doesn't refer to an earlier node
+static int addNode(NoiseGraph* graph, NoiseNodeType type, int a, int b, int c)
+{
+    int inputs[3] = { a, b, c };
+    for (int i = 0; i < 3; i++) {
+        if (inputs[i] < -1 || inputs[i] >= graph->nodeCount)
+            return -1;
+    }
+
+    if (graph->nodeCount == graph->nodeCapacity) {
+        int capacity = graph->nodeCapacity > 0 ? graph->nodeCapacity * 2 : 16;
+        NoiseNode* nodes = (NoiseNode*)realloc(graph->nodes, capacity * sizeof(NoiseNode));
+        if (nodes == NULL)
+            return -1;
+        graph->nodes = nodes;
+        graph->nodeCapacity = capacity;
+    }
+
+    NoiseNode* node = &graph->nodes[graph->nodeCount];
+    memset(node, 0, sizeof(NoiseNode));
+    node->type = type;
+    node->inputs[0] = a;
+    node->inputs[1] = b;
+    node->inputs[2] = c;
+
+    // Edits invalidate the compiled program
+    graph->outputRegister = -1;
+
+    return graph->nodeCount++;
+}
+
+static int addOctaveNode(NoiseGraph* graph, NoiseNodeType type, float frequency, int depth)
+{
+    if (depth < 1)
+        return -1;
+
+    int index = addNode(graph, type, -1, -1, -1);
+    if (index >= 0) {
+        graph->nodes[index].frequency = frequency;
+        graph->nodes[index].depth = depth;
+    }
+
+    return index;
+}
+
+// Value noise octaves summed like perlin2d
+int addFbmNode(NoiseGraph* graph, float frequency, int depth)
+{
+    return addOctaveNode(graph, NOISE_NODE_FBM, frequency, depth);
+}
+
+// Gradient noise folded at its zero crossings into sharp crests, for mountain ranges
+int addRidgedNode(NoiseGraph* graph, float frequency, int depth)
+{
+    return addOctaveNode(graph, NOISE_NODE_RIDGED, frequency, depth);
+}
+
+// Gradient noise folded into rounded lumps, for hills and dunes
+int addBillowNode(NoiseGraph* graph, float frequency, int depth)
+{
+    return addOctaveNode(graph, NOISE_NODE_BILLOW, frequency, depth);
+}
+
+// Evaluates source at coordinates moved by (warp - 0.5) * strength world units on each axis
+int addWarpNode(NoiseGraph* graph, int source, int warpX, int warpY, float strength)
+{
+    if (source < 0 || warpX < 0 || warpY < 0)
+        return -1;
+
+    int index = addNode(graph, NOISE_NODE_WARP, source, warpX, warpY);
+    if (index >= 0)
+        graph->nodes[index].parameters[0] = strength;
+
+    return index;
+}
+
+int addAddNode(NoiseGraph* graph, int a, int b)
+{
+    if (a < 0 || b < 0)
+        return -1;
+
+    return addNode(graph, NOISE_NODE_ADD, a, b, -1);
+}
+
+int addMulNode(NoiseGraph* graph, int a, int b)
+{
+    if (a < 0 || b < 0)
+        return -1;
+
+    return addNode(graph, NOISE_NODE_MUL, a, b, -1);
+}
+
+// a where mask is 0, b where it is 1
+int addBlendNode(NoiseGraph* graph, int a, int b, int mask)
+{
+    if (a < 0 || b < 0 || mask < 0)
+        return -1;
+
+    return addNode(graph, NOISE_NODE_BLEND, a, b, mask);
+}
+
+int addClampNode(NoiseGraph* graph, int input, float min, float max)
+{
+    if (input < 0)
+        return -1;
+
+    int index = addNode(graph, NOISE_NODE_CLAMP, input, -1, -1);
+    if (index >= 0) {
+        graph->nodes[index].parameters[0] = min;
+        graph->nodes[index].parameters[1] = max;
+    }
+
+    return index;
+}
+
+// Piecewise linear remap, points holds pointCount x, y pairs with ascending x. Inputs outside
+// the first and last x take the end values.
+int addCurveNode(NoiseGraph* graph, int input, const float* points, int pointCount)
+{
+    if (input < 0 || pointCount < 1 || pointCount > NOISE_CURVE_MAX_POINTS)
+        return -1;
+
+    for (int i = 1; i < pointCount; i++) {
+        if (points[i * 2] <= points[(i - 1) * 2])
+            return -1;
+    }
+
+    int index = addNode(graph, NOISE_NODE_CURVE, input, -1, -1);
+    if (index >= 0) {
+        graph->nodes[index].pointCount = pointCount;
+        memcpy(graph->nodes[index].points, points, pointCount * 2 * sizeof(float));
+    }
+
+    return index;
+}
+
+int addConstantNode(NoiseGraph* graph, float value)
+{
+    int index = addNode(graph, NOISE_NODE_CONSTANT, -1, -1, -1);
+    if (index >= 0)
+        graph->nodes[index].parameters[0] = value;
+
+    return index;
+}
+
+// A node evaluated at a pair of coordinate registers. Warps evaluate their source at other
+// coordinates, so one node can appear several times in the program.
+typedef struct {
+    int node;
+    int coordX;
+    int coordY;
+    int target;
+} EmittedNode;
+
+typedef struct {
+    NoiseGraph* graph;
+    NoiseInstruction* program;
+    int instructionCount;
+    int instructionCapacity;
+    EmittedNode* emitted;
+    int emittedCount;
+    int emittedCapacity;
+    int registerCount;      // Virtual registers, one per instruction plus the coordinates
+    bool failed;
+} NoiseCompiler;
+
+static int emitInstruction(NoiseCompiler* compiler, NoiseOp op, int node, int a, int b, int c)
+{
+    if (compiler->instructionCount == compiler->instructionCapacity) {
+        int capacity = compiler->instructionCapacity > 0 ? compiler->instructionCapacity * 2 : 32;
+        NoiseInstruction* program = (NoiseInstruction*)realloc(compiler->program, capacity * sizeof(NoiseInstruction));
+        if (program == NULL) {
+            compiler->failed = true;
+            return NOISE_REGISTER_X;
+        }
+        compiler->program = program;
+        compiler->instructionCapacity = capacity;
+    }
+
+    NoiseInstruction* instruction = &compiler->program[compiler->instructionCount++];
+    instruction->op = op;
+    instruction->target = compiler->registerCount++;
+    instruction->sources[0] = a;
+    instruction->sources[1] = b;
+    instruction->sources[2] = c;
+    instruction->node = node;
+    instruction->band = -1;
+
+    return instruction->target;
+}
+
+static int emitNode(NoiseCompiler* compiler, int index, int coordX, int coordY)
+{
+    for (int i = 0; i < compiler->emittedCount; i++) {
+        EmittedNode* emitted = &compiler->emitted[i];
+        if (emitted->node == index && emitted->coordX == coordX && emitted->coordY == coordY)
+            return emitted->target;
+    }
+
+    const NoiseNode* node = &compiler->graph->nodes[index];
+    int target;
+
+    switch (node->type) {
+    case NOISE_NODE_FBM:
+    case NOISE_NODE_RIDGED:
+    case NOISE_NODE_BILLOW:
+        target = emitInstruction(compiler, NOISE_OP_OCTAVES, index, coordX, coordY, -1);
+        break;
+    case NOISE_NODE_WARP: {
+        int warpX = emitNode(compiler, node->inputs[1], coordX, coordY);
+        int warpY = emitNode(compiler, node->inputs[2], coordX, coordY);
+        int movedX = emitInstruction(compiler, NOISE_OP_DISPLACE, index, coordX, warpX, -1);
+        int movedY = emitInstruction(compiler, NOISE_OP_DISPLACE, index, coordY, warpY, -1);
+        target = emitNode(compiler, node->inputs[0], movedX, movedY);
+        break;
+    }
+    case NOISE_NODE_ADD:
+    case NOISE_NODE_MUL: {
+        int a = emitNode(compiler, node->inputs[0], coordX, coordY);
+        int b = emitNode(compiler, node->inputs[1], coordX, coordY);
+        target = emitInstruction(compiler, node->type == NOISE_NODE_ADD ? NOISE_OP_ADD : NOISE_OP_MUL, index, a, b, -1);
+        break;
+    }
+    case NOISE_NODE_BLEND: {
+        int a = emitNode(compiler, node->inputs[0], coordX, coordY);
+        int b = emitNode(compiler, node->inputs[1], coordX, coordY);
+        int mask = emitNode(compiler, node->inputs[2], coordX, coordY);
+        target = emitInstruction(compiler, NOISE_OP_BLEND, index, a, b, mask);
+        break;
+    }
+    case NOISE_NODE_CLAMP:
+    case NOISE_NODE_CURVE: {
+        int input = emitNode(compiler, node->inputs[0], coordX, coordY);
+        target = emitInstruction(compiler, node->type == NOISE_NODE_CLAMP ? NOISE_OP_CLAMP : NOISE_OP_CURVE, index, input, -1, -1);
+        break;
+    }
+    default:
+        // Constants don't depend on the coordinates, every warp shares one
+        coordX = -1;
+        coordY = -1;
+        for (int i = 0; i < compiler->emittedCount; i++) {
+            if (compiler->emitted[i].node == index)
+                return compiler->emitted[i].target;
+        }
+        target = emitInstruction(compiler, NOISE_OP_CONSTANT, index, -1, -1, -1);
+        break;
+    }
+
+    if (compiler->emittedCount == compiler->emittedCapacity) {
+        int capacity = compiler->emittedCapacity > 0 ? compiler->emittedCapacity * 2 : 32;
+        EmittedNode* emitted = (EmittedNode*)realloc(compiler->emitted, capacity * sizeof(EmittedNode));
+        if (emitted == NULL) {
+            compiler->failed = true;
+            return target;
+        }
+        compiler->emitted = emitted;
+        compiler->emittedCapacity = capacity;
+    }
+
+    EmittedNode* emitted = &compiler->emitted[compiler->emittedCount++];
+    emitted->node = index;
+    emitted->coordX = coordX;
+    emitted->coordY = coordY;
+    emitted->target = target;
+
+    return target;
+}
+
+// Maps virtual registers onto as few tile registers as possible. A register is recycled
+// after the last instruction reading it, but never as that instruction's own target, so
+// the octave loop can keep reading its coordinates while it writes.
+static bool allocateRegisters(NoiseCompiler* compiler, int output, int* outputRegister, int* registerCount)
+{
+    int virtualCount = compiler->registerCount;
+    int* lastUse = (int*)malloc(virtualCount * sizeof(int));
+    int* physical = (int*)malloc(virtualCount * sizeof(int));
+    int* freeRegisters = (int*)malloc(virtualCount * sizeof(int));
+    if (lastUse == NULL || physical == NULL || freeRegisters == NULL) {
+        free(lastUse);
+        free(physical);
+        free(freeRegisters);
+        return false;
+    }
+
+    for (int i = 0; i < virtualCount; i++)
+        lastUse[i] = -1;
+    for (int i = 0; i < compiler->instructionCount; i++) {
+        for (int s = 0; s < 3; s++) {
+            if (compiler->program[i].sources[s] >= 0)
+                lastUse[compiler->program[i].sources[s]] = i;
+        }
+    }
+    lastUse[NOISE_REGISTER_X] = INT_MAX;
+    lastUse[NOISE_REGISTER_Y] = INT_MAX;
+    lastUse[output] = INT_MAX;
+
+    physical[NOISE_REGISTER_X] = NOISE_REGISTER_X;
+    physical[NOISE_REGISTER_Y] = NOISE_REGISTER_Y;
+    int used = 2;
+    int freeCount = 0;
+
+    for (int i = 0; i < compiler->instructionCount; i++) {
+        NoiseInstruction* instruction = &compiler->program[i];
+        int target = instruction->target;
+        physical[target] = freeCount > 0 ? freeRegisters[--freeCount] : used++;
+
+        for (int s = 0; s < 3; s++) {
+            int source = instruction->sources[s];
+            if (source < 0)
+                continue;
+
+            instruction->sources[s] = physical[source];
+            if (lastUse[source] != i)
+                continue;
+
+            // The same register can feed several sources of one instruction
+            bool freed = false;
+            for (int other = 0; other < s; other++)
+                freed |= instruction->sources[other] == physical[source];
+            if (!freed)
+                freeRegisters[freeCount++] = physical[source];
+        }
+
+        instruction->target = physical[target];
+    }
+
+    *outputRegister = physical[output];
+    *registerCount = used;
+
+    free(lastUse);
+    free(physical);
+    free(freeRegisters);
+
+    return true;
+}
+
+// Turns the nodes reachable from output into the program evaluateNoiseGraph runs
+bool compileNoiseGraph(NoiseGraph* graph, int output)
+{
+    if (output < 0 || output >= graph->nodeCount)
+        return false;
+
+    NoiseCompiler compiler = { graph, NULL, 0, 0, NULL, 0, 0, 2, false };
+    int target = emitNode(&compiler, output, NOISE_REGISTER_X, NOISE_REGISTER_Y);
+    free(compiler.emitted);
+
+    int outputRegister, registerCount;
+    if (compiler.failed || !allocateRegisters(&compiler, target, &outputRegister, &registerCount)) {
+        free(compiler.program);
+        return false;
+    }
+
+    // Fbm at the sample coordinates themselves doesn't need the tiles, perlin2dTile fills
+    // whole bands of it at once. Graphs of nothing else never need the coordinates written.
+    int bandCount = 0;
+    bool readsCoordinates = false;
+    for (int i = 0; i < compiler.instructionCount; i++) {
+        NoiseInstruction* instruction = &compiler.program[i];
+        if (instruction->op == NOISE_OP_OCTAVES && graph->nodes[instruction->node].type == NOISE_NODE_FBM
+            && instruction->sources[0] == NOISE_REGISTER_X && instruction->sources[1] == NOISE_REGISTER_Y) {
+            instruction->band = bandCount++;
+            continue;
+        }
+
+        for (int s = 0; s < 3; s++)
+            readsCoordinates |= instruction->sources[s] == NOISE_REGISTER_X || instruction->sources[s] == NOISE_REGISTER_Y;
+    }
+
+    free(graph->program);
+    graph->program = compiler.program;
+    graph->instructionCount = compiler.instructionCount;
+    graph->registerCount = registerCount;
+    graph->bandCount = bandCount;
+    graph->readsCoordinates = readsCoordinates;
+    graph->outputRegister = outputRegister;
+
+    return true;
+}
+
+typedef struct {
+    int x;          // First sample, counted in samples
+    int y;
+    int width;
+    int height;
+    int lod;
+} NoiseTile;
+
+// Fills every band buffer for the rows of one band, width samples wide, before its tiles run.
+// Unwarped value noise takes perlin2dTile's cached lattice rows across the whole band.
+static void fillBands(const NoiseGraph* graph, float* bands, int width, int height, int x, int y, int lod)
+{
+    const float spacing = (float)(1 << lod);
+
+    for (int i = 0; i < graph->instructionCount; i++) {
+        const NoiseInstruction* instruction = &graph->program[i];
+        if (instruction->band < 0)
+            continue;
+
+        const NoiseNode* node = &graph->nodes[instruction->node];
+        int octaves = countResolvedOctaves(node->frequency * spacing, node->depth, NOISE_GRAPH_MIN_WAVELENGTH);
+        float* band = bands + instruction->band * width * NOISE_GRAPH_BAND_HEIGHT;
+        perlin2dTile(band, width, height, x, y, graph->noise, node->frequency * spacing, octaves);
+    }
+}
+
+// Sums the resolved octaves of an octave node. band is the node's filled band buffer, starting
+// at the tile's first sample, or NULL to go through the SIMD point kernels.
+static void runOctaves(const NoiseGraph* graph, const NoiseNode* node, float* target, const float* coordX, const float* coordY,
+    const float* band, int bandWidth, const NoiseTile* tile, float* scratch)
+{
+    const int count = tile->width * tile->height;
+    const float spacing = (float)(1 << tile->lod);
+    int octaves = countResolvedOctaves(node->frequency * spacing, node->depth, NOISE_GRAPH_MIN_WAVELENGTH);
+    float share = octaves < node->depth ? octaveAmplitudeShare(octaves, node->depth) : 1.0f;
+
+    if (band != NULL) {
+        for (int j = 0; j < tile->height; j++)
+            memcpy(target + j * tile->width, band + j * bandWidth, tile->width * sizeof(float));
+    }
+    else {
+        float* xa = scratch;
+        float* ya = scratch + NOISE_GRAPH_TILE_SIZE;
+        float* sample = scratch + NOISE_GRAPH_TILE_SIZE * 2;
+
+        for (int i = 0; i < count; i++) {
+            xa[i] = coordX[i] * node->frequency;
+            ya[i] = coordY[i] * node->frequency;
+        }
+
+        float amp = 1.0f;
+        float div = 0.0f;
+
+        for (int octave = 0; octave < octaves; octave++) {
+            if (node->type == NOISE_NODE_FBM) {
+                valueNoisePoints(sample, xa, ya, count, graph->noise);
+                div += 256 * amp;
+            }
+            else {
+                gradientNoisePoints(sample, xa, ya, count, graph->noise);
+                div += amp;
+
+                if (node->type == NOISE_NODE_RIDGED) {
+                    for (int i = 0; i < count; i++) {
+                        float ridge = 1.0f - fminf(fabsf(sample[i]) * GRADIENT_NOISE_SCALE, 1.0f);
+                        sample[i] = ridge * ridge;
+                    }
+                }
+                else {
+                    for (int i = 0; i < count; i++)
+                        sample[i] = fminf(fabsf(sample[i]) * GRADIENT_NOISE_SCALE, 1.0f);
+                }
+            }
+
+            if (octave == 0) {
+                for (int i = 0; i < count; i++)
+                    target[i] = sample[i] * amp;
+            }
+            else {
+                for (int i = 0; i < count; i++)
+                    target[i] += sample[i] * amp;
+            }
+
+            amp /= 2;
+            for (int i = 0; i < count; i++) {
+                xa[i] *= 2;
+                ya[i] *= 2;
+            }
+        }
+
+        for (int i = 0; i < count; i++)
+            target[i] /= div;
+    }
+
+    if (share < 1.0f) {
+        float mean = node->type == NOISE_NODE_FBM ? VALUE_OCTAVE_MEAN : (node->type == NOISE_NODE_RIDGED ? RIDGED_OCTAVE_MEAN : BILLOW_OCTAVE_MEAN);
+        float bias = mean * (1.0f - share);
+        for (int i = 0; i < count; i++)
+            target[i] = target[i] * share + bias;
+    }
+}
+
+static void runCurve(const NoiseNode* node, float* target, const float* input, int count)
+{
+    const float* points = node->points;
+    const int last = node->pointCount - 1;
+
+    for (int i = 0; i < count; i++) {
+        float x = input[i];
+        float y = x <= points[0] ? points[1] : points[last * 2 + 1];
+
+        for (int p = 1; p <= last; p++) {
+            if (x > points[(p - 1) * 2] && x <= points[p * 2]) {
+                float t = (x - points[(p - 1) * 2]) / (points[p * 2] - points[(p - 1) * 2]);
+                y = points[(p - 1) * 2 + 1] + t * (points[p * 2 + 1] - points[(p - 1) * 2 + 1]);
+                break;
+            }
+        }
+
+        target[i] = y;
+    }
+}
+
+// bands holds the filled band buffers, offset to the tile's first sample, bandWidth samples wide
+static void runProgram(const NoiseGraph* graph, float* registers, const float* bands, int bandWidth, const NoiseTile* tile, float* scratch)
+{
+    const int count = tile->width * tile->height;
+
+    for (int i = 0; i < graph->instructionCount; i++) {
+        const NoiseInstruction* instruction = &graph->program[i];
+        const NoiseNode* node = &graph->nodes[instruction->node];
+        float* target = registers + instruction->target * NOISE_GRAPH_TILE_SIZE;
+        const float* a = registers + instruction->sources[0] * NOISE_GRAPH_TILE_SIZE;
+        const float* b = registers + instruction->sources[1] * NOISE_GRAPH_TILE_SIZE;
+        const float* c = registers + instruction->sources[2] * NOISE_GRAPH_TILE_SIZE;
+
+        switch (instruction->op) {
+        case NOISE_OP_OCTAVES: {
+            const float* band = instruction->band >= 0 ? bands + instruction->band * bandWidth * NOISE_GRAPH_BAND_HEIGHT : NULL;
+            runOctaves(graph, node, target, a, b, band, bandWidth, tile, scratch);
+            break;
+        }
+        case NOISE_OP_DISPLACE: {
+            float strength = node->parameters[0];
+            for (int s = 0; s < count; s++)
+                target[s] = a[s] + (b[s] - 0.5f) * strength;
+            break;
+        }
+        case NOISE_OP_ADD:
+            for (int s = 0; s < count; s++)
+                target[s] = a[s] + b[s];
+            break;
+        case NOISE_OP_MUL:
+            for (int s = 0; s < count; s++)
+                target[s] = a[s] * b[s];
+            break;
+        case NOISE_OP_BLEND:
+            for (int s = 0; s < count; s++)
+                target[s] = a[s] + (b[s] - a[s]) * c[s];
+            break;
+        case NOISE_OP_CLAMP: {
+            float min = node->parameters[0];
+            float max = node->parameters[1];
+            for (int s = 0; s < count; s++)
+                target[s] = a[s] < min ? min : (a[s] > max ? max : a[s]);
+            break;
+        }
+        case NOISE_OP_CURVE:
+            runCurve(node, target, a, count);
+            break;
+        case NOISE_OP_CONSTANT:
+            for (int s = 0; s < count; s++)
+                target[s] = node->parameters[0];
+            break;
+        }
+    }
+}
+
+// Evaluates the compiled graph at samples (x + i, y + j) for a width by height block, out is
+// row major. Samples are 1 << lod world units apart and node frequencies are per world unit.
+// Returns false without touching out when the graph isn't compiled or its registers can't be allocated.
+bool evaluateNoiseGraph(const NoiseGraph* graph, float* out, int width, int height, int x, int y, int lod)
+{
+    if (graph->outputRegister < 0)
+        return false;
+
+    float* registers = (float*)malloc((graph->registerCount + 3) * NOISE_GRAPH_TILE_SIZE * sizeof(float));
+    float* bands = (float*)malloc(graph->bandCount * width * NOISE_GRAPH_BAND_HEIGHT * sizeof(float));
+    if (registers == NULL || (bands == NULL && graph->bandCount > 0)) {
+        free(registers);
+        free(bands);
+        return false;
+    }
+
+    float* scratch = registers + graph->registerCount * NOISE_GRAPH_TILE_SIZE;
+    float* coordX = registers + NOISE_REGISTER_X * NOISE_GRAPH_TILE_SIZE;
+    float* coordY = registers + NOISE_REGISTER_Y * NOISE_GRAPH_TILE_SIZE;
+    const float* output = registers + graph->outputRegister * NOISE_GRAPH_TILE_SIZE;
+    const float spacing = (float)(1 << lod);
+
+    for (int tileY = 0; tileY < height; tileY += NOISE_GRAPH_TILE_HEIGHT) {
+        int bandRow = tileY % NOISE_GRAPH_BAND_HEIGHT;
+        if (bandRow == 0) {
+            int bandHeight = height - tileY < NOISE_GRAPH_BAND_HEIGHT ? height - tileY : NOISE_GRAPH_BAND_HEIGHT;
+            fillBands(graph, bands, width, bandHeight, x, y + tileY, lod);
+        }
+
+        for (int tileX = 0; tileX < width; tileX += NOISE_GRAPH_TILE_WIDTH) {
+            NoiseTile tile;
+            tile.x = x + tileX;
+            tile.y = y + tileY;
+            tile.width = width - tileX < NOISE_GRAPH_TILE_WIDTH ? width - tileX : NOISE_GRAPH_TILE_WIDTH;
+            tile.height = height - tileY < NOISE_GRAPH_TILE_HEIGHT ? height - tileY : NOISE_GRAPH_TILE_HEIGHT;
+            tile.lod = lod;
+
+            // Power of two spacings scale coordinates exactly
+            if (graph->readsCoordinates) {
+                for (int j = 0; j < tile.height; j++) {
+                    for (int i = 0; i < tile.width; i++) {
+                        coordX[j * tile.width + i] = (float)(tile.x + i) * spacing;
+                        coordY[j * tile.width + i] = (float)(tile.y + j) * spacing;
+                    }
+                }
+            }
+
+            const float* tileBands = bands != NULL ? bands + bandRow * width + tileX : NULL;
+            runProgram(graph, registers, tileBands, width, &tile, scratch);
+
+            for (int j = 0; j < tile.height; j++)
+                memcpy(out + (tileY + j) * width + tileX, output + j * tile.width, tile.width * sizeof(float));
+        }
+    }
+
+    free(registers);
+    free(bands);
+    return true;
+}
+
+void cleanNoiseGraph(NoiseGraph* graph)
+{
+    free(graph->nodes);
+    free(graph->program);
+    free(graph);
+}
\ No newline at end of file
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "noise.h"
+
+// Nodes are added bottom up and referenced by the index the add functions return, so every
+// node only refers to nodes added before it. Octave nodes output about 0 to 1.
+typedef struct NoiseGraph NoiseGraph;
+
+NoiseGraph* createNoiseGraph(const Noise* noise);
+int addFbmNode(NoiseGraph* graph, float frequency, int depth);
+int addRidgedNode(NoiseGraph* graph, float frequency, int depth);
+int addBillowNode(NoiseGraph* graph, float frequency, int depth);
+int addWarpNode(NoiseGraph* graph, int source, int warpX, int warpY, float strength);
+int addAddNode(NoiseGraph* graph, int a, int b);
+int addMulNode(NoiseGraph* graph, int a, int b);
+int addBlendNode(NoiseGraph* graph, int a, int b, int mask);
+int addClampNode(NoiseGraph* graph, int input, float min, float max);
+int addCurveNode(NoiseGraph* graph, int input, const float* points, int pointCount);
+int addConstantNode(NoiseGraph* graph, float value);
+bool compileNoiseGraph(NoiseGraph* graph, int output);
+bool evaluateNoiseGraph(const NoiseGraph* graph, float* out, int width, int height, int x, int y, int lod);
+void cleanNoiseGraph(NoiseGraph* graph);
\ No newline at end of file
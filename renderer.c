@@ -5,54 +5,401 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stddef.h>
 
 #include "math2.h"
-#include "mesh.h";
-#include "shader.h";
+#include "mesh.h"
+#include "shader.h"
 
 
-Renderer* createRenderer(Mesh* mesh, Shader* shader, GLuint* textures, int texturesCount)
+static void setVertexAttribute(GLint attribute, GLint size, GLenum type, GLboolean normalized, GLsizei stride, size_t offset)
+{
+    if (attribute == -1)
+        return;
+
+    glVertexAttribPointer(attribute, size, type, normalized, stride, (void*)offset);
+    glEnableVertexAttribArray(attribute);
+}
+
+// Bytes per vertex in the GPU buffers, or in an upload for VERTEX_FORMAT_HEIGHT_TEXTURE
+static GLsizei getVertexSize(VertexFormat format)
+{
+    if (format == VERTEX_FORMAT_HEIGHT_TEXTURE)
+        return sizeof(GLfloat) + 2 * sizeof(GLshort);
+
+    return format == VERTEX_FORMAT_PACKED ? sizeof(PackedVertex) : MESH_VERTEX_FLOATS * sizeof(GLfloat);
+}
+
+// Points the VAO's vertex attributes at renderer->vbo, the buffer is captured when the pointer is set.
+// VERTEX_FORMAT_HEIGHT_TEXTURE has no vertex buffer and no attributes, the shader rebuilds each
+// vertex from gl_VertexID and the textures.
+static void recordVertexLayout(Renderer* renderer)
+{
+    const GLsizei stride = getVertexSize(renderer->vertexFormat);
+    GLint* attributes = renderer->shader->attributes;
+
+    glBindVertexArray(renderer->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, renderer->vbo);
+
+    if (renderer->vertexFormat == VERTEX_FORMAT_PACKED) {
+        // Grid x, grid z and the quantized height arrive as plain integers in position.xyz
+        setVertexAttribute(attributes[ATTRIBUTE_POSITION], 3, GL_UNSIGNED_SHORT, GL_FALSE, stride, offsetof(PackedVertex, x));
+        setVertexAttribute(attributes[ATTRIBUTE_NORMAL], 2, GL_SHORT, GL_TRUE, stride, offsetof(PackedVertex, normal));
+    }
+    else {
+        setVertexAttribute(attributes[ATTRIBUTE_POSITION], 3, GL_FLOAT, GL_FALSE, stride, MESH_POSITION_OFFSET * sizeof(GLfloat));
+        setVertexAttribute(attributes[ATTRIBUTE_TEX_COORD], 2, GL_FLOAT, GL_FALSE, stride, MESH_TEX_COORD_OFFSET * sizeof(GLfloat));
+        setVertexAttribute(attributes[ATTRIBUTE_NORMAL], 3, GL_FLOAT, GL_FALSE, stride, MESH_NORMAL_OFFSET * sizeof(GLfloat));
+    }
+
+    glBindVertexArray(0);
+}
+
+// One texel per grid vertex, sized to the current mesh
+static void allocateHeightTextures(Renderer* renderer)
+{
+    int width = renderer->mesh->gridWidth;
+    int length = renderer->mesh->vertexCount / width;
+
+    glBindTexture(GL_TEXTURE_2D, renderer->heightTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, length, 0, GL_RED, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glBindTexture(GL_TEXTURE_2D, renderer->normalTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16_SNORM, width, length, 0, GL_RG, GL_SHORT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// Both whole textures. With a pixel unpack buffer bound the pointers are offsets into it.
+static void uploadTexels(Renderer* renderer, const void* heights, const void* normals)
+{
+    int width = renderer->mesh->gridWidth;
+    int length = renderer->mesh->vertexCount / width;
+
+    glBindTexture(GL_TEXTURE_2D, renderer->heightTexture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, length, GL_RED, GL_FLOAT, heights);
+
+    glBindTexture(GL_TEXTURE_2D, renderer->normalTexture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, length, GL_RG, GL_SHORT, normals);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// Respecifies renderer->vbo, or the textures, with every vertex of the mesh, packing them on the way if needed
+static void uploadMeshVertices(Renderer* renderer)
+{
+    Mesh* mesh = renderer->mesh;
+    const GLsizei vertexSize = getVertexSize(renderer->vertexFormat);
+
+    if (renderer->vertexFormat == VERTEX_FORMAT_HEIGHT_TEXTURE) {
+        // A grid without vertices starts flat, zero heights and normals encoded as straight up
+        float* heights = (float*)calloc(mesh->vertexCount, vertexSize);
+        if (heights == NULL)
+            return;
+
+        GLshort* normals = (GLshort*)(heights + mesh->vertexCount);
+        if (mesh->vertices != NULL)
+            packMeshTexels(mesh, heights, normals);
+        uploadTexels(renderer, heights, normals);
+
+        free(heights);
+        return;
+    }
+
+    const void* data = mesh->vertices;
+    PackedVertex* packed = NULL;
+    if (renderer->vertexFormat == VERTEX_FORMAT_PACKED) {
+        packed = (PackedVertex*)malloc(mesh->vertexCount * sizeof(PackedVertex));
+        if (packed == NULL)
+            return;
+
+        packMeshVertices(mesh, packed);
+        data = packed;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, renderer->vbo);
+    glBufferData(GL_ARRAY_BUFFER, mesh->vertexCount * vertexSize, data, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    free(packed);
+}
+
+// VERTEX_FORMAT_PACKED and VERTEX_FORMAT_HEIGHT_TEXTURE only suit meshes from generatePlaneMesh
+// and shaders that decode them
+Renderer* createRenderer(Mesh* mesh, Shader* shader, GLuint* textures, int texturesCount, VertexFormat vertexFormat)
 {
     Renderer* renderer = (Renderer*)malloc(sizeof(Renderer));
     glGenVertexArrays(1, &renderer->vao);
-    glGenBuffers(1, &renderer->vbo[0]); // Vertices
-    glGenBuffers(1, &renderer->vbo[1]); // Normals
     glGenBuffers(1, &renderer->ebo);
+    glGenBuffers(1, &renderer->drawUbo);
+    renderer->vbo = 0;
+    renderer->vboMapping = NULL;
+    renderer->uploadVbo = 0;
+    renderer->uploadMapping = NULL;
+    renderer->uploadOpen = false;
+    renderer->uploadFence = NULL;
+    renderer->vertexFormat = vertexFormat;
     renderer->mesh = mesh;
     renderer->shader = shader;
     renderer->textures = textures;
     renderer->texturesCount = texturesCount;
+    renderer->heightTexture = 0;
+    renderer->normalTexture = 0;
+
+    // Allocate GPU storage and record the attribute layout in the VAO once
+    if (vertexFormat == VERTEX_FORMAT_HEIGHT_TEXTURE) {
+        glGenTextures(1, &renderer->heightTexture);
+        glGenTextures(1, &renderer->normalTexture);
+        allocateHeightTextures(renderer);
+    }
+    else {
+        glGenBuffers(1, &renderer->vbo);
+        recordVertexLayout(renderer);
+    }
+
+    uploadMeshVertices(renderer);
+
+    glBindVertexArray(renderer->vao);
+
+    // Element buffer binding is part of the VAO state
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, renderer->ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh->indexCount * sizeof(GLuint), mesh->indices, GL_STATIC_DRAW);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    renderer->meshVersion = mesh->version;
+
+    // Per-draw constants, the model starts zeroed so the first draw always uploads
+    memset(&renderer->drawData, 0, sizeof(DrawData));
+    glBindBuffer(GL_UNIFORM_BUFFER, renderer->drawUbo);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(DrawData), &renderer->drawData, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
     return renderer;
 }
 
-void renderMesh(Renderer* renderer, float* model, Camera* camera, float* clipPlane)
+// Swaps in another mesh, such as a chunk generated in the background. The buffers are
+// respecified rather than updated, so draws still reading the old data don't stall the upload.
+void setRendererMesh(Renderer* renderer, Mesh* mesh)
 {
-    // Generate and bind a VAO for each terrain chunk
+    renderer->mesh = mesh;
+
+    // Immutable storage can't be respecified, a fresh buffer takes its place
+    if (renderer->vboMapping != NULL) {
+        glBindBuffer(GL_ARRAY_BUFFER, renderer->vbo);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glDeleteBuffers(1, &renderer->vbo);
+        glGenBuffers(1, &renderer->vbo);
+        renderer->vboMapping = NULL;
+        recordVertexLayout(renderer);
+    }
+
+    if (renderer->vertexFormat == VERTEX_FORMAT_HEIGHT_TEXTURE)
+        allocateHeightTextures(renderer);
+
+    uploadMeshVertices(renderer);
+
     glBindVertexArray(renderer->vao);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, renderer->ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh->indexCount * sizeof(GLuint), mesh->indices, GL_STATIC_DRAW);
+    glBindVertexArray(0);
 
-    // Create a Vertex Buffer Object and copy the vertex data to it
-    glBindBuffer(GL_ARRAY_BUFFER, renderer->vbo[0]);
-    glBufferData(GL_ARRAY_BUFFER, renderer->mesh->vertexCount * 5 * sizeof(GLfloat), renderer->mesh->vertices, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-    GLint positionAttribute = glGetAttribLocation(renderer->shader->program, "position");
-    glVertexAttribPointer(positionAttribute, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), 0);
-    glEnableVertexAttribArray(positionAttribute);
+    renderer->meshVersion = mesh->version;
+}
 
-    GLint textureAttribute = glGetAttribLocation(renderer->shader->program, "texCoord");
-    glVertexAttribPointer(textureAttribute, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (void*)(3 * sizeof(GLfloat)));
-    glEnableVertexAttribArray(textureAttribute);
+static void waitFence(GLsync* fence)
+{
+    if (*fence == NULL)
+        return;
 
-    // Create a Normals Buffer Object and copy the vertex data to it
-    glBindBuffer(GL_ARRAY_BUFFER, renderer->vbo[1]);
-    glBufferData(GL_ARRAY_BUFFER, renderer->mesh->vertexCount * 3 * sizeof(GLfloat), renderer->mesh->normals, GL_STATIC_DRAW);
+    while (glClientWaitSync(*fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED);
 
-    GLint normalsAttribute = glGetAttribLocation(renderer->shader->program, "normal");
-    glVertexAttribPointer(normalsAttribute, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), 0);
-    glEnableVertexAttribArray(normalsAttribute);
+    glDeleteSync(*fence);
+    *fence = NULL;
+}
 
-    // Create an Element Buffer Object and copy the index data to it
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, renderer->ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, renderer->mesh->indexCount * sizeof(GLuint), renderer->mesh->indices, GL_STATIC_DRAW);
+// Hands out memory for vertexCount vertices in the renderer's format that lands in the GPU buffer
+// without another copy, or NULL if the driver can't map one. The vertices may be written from
+// any thread until endRendererUpload draws from them. Asking again before that returns the
+// same memory, so a replaced request simply overwrites it.
+// VERTEX_FORMAT_HEIGHT_TEXTURE takes all heights as floats followed by all packed normals,
+// the buffer feeds the textures as a pixel unpack buffer.
+void* beginRendererUpload(Renderer* renderer)
+{
+    if (renderer->uploadOpen)
+        return renderer->uploadMapping;
+
+    GLsizeiptr size = renderer->mesh->vertexCount * getVertexSize(renderer->vertexFormat);
+    GLenum target = renderer->vertexFormat == VERTEX_FORMAT_HEIGHT_TEXTURE ? GL_PIXEL_UNPACK_BUFFER : GL_ARRAY_BUFFER;
+
+    // The draws that last read the spare buffer have to finish before it is written again
+    waitFence(&renderer->uploadFence);
+
+    if (GLEW_ARB_buffer_storage) {
+        // Persistently mapped, the spare buffer is mapped once and written in place after that
+        if (renderer->uploadMapping == NULL) {
+            if (renderer->uploadVbo != 0)
+                glDeleteBuffers(1, &renderer->uploadVbo);
+
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glGenBuffers(1, &renderer->uploadVbo);
+            glBindBuffer(target, renderer->uploadVbo);
+            glBufferStorage(target, size, NULL, flags | GL_DYNAMIC_STORAGE_BIT);
+            renderer->uploadMapping = glMapBufferRange(target, 0, size, flags);
+        }
+    }
+    else {
+        // Mapped for the duration of one upload, invalidating lets the driver skip the readback
+        if (renderer->uploadVbo == 0) {
+            glGenBuffers(1, &renderer->uploadVbo);
+            glBindBuffer(target, renderer->uploadVbo);
+            glBufferData(target, size, NULL, GL_STATIC_DRAW);
+        }
+
+        glBindBuffer(target, renderer->uploadVbo);
+        renderer->uploadMapping = glMapBufferRange(target, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    }
+
+    glBindBuffer(target, 0);
+
+    renderer->uploadOpen = renderer->uploadMapping != NULL;
+    return renderer->uploadMapping;
+}
+
+// Draws from the vertices written since beginRendererUpload from now on. Only call once they
+// are complete, the buffer drawn so far becomes the spare for the next upload.
+void endRendererUpload(Renderer* renderer)
+{
+    if (!renderer->uploadOpen)
+        return;
+
+    // The textures copy out of the upload buffer on the GPU, it stays the spare
+    if (renderer->vertexFormat == VERTEX_FORMAT_HEIGHT_TEXTURE) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, renderer->uploadVbo);
+        if (!GLEW_ARB_buffer_storage) {
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            renderer->uploadMapping = NULL;
+        }
+
+        uploadTexels(renderer, (void*)0, (void*)(renderer->mesh->vertexCount * sizeof(GLfloat)));
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        // The copies have to finish before the buffer is written again
+        renderer->uploadFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        renderer->uploadOpen = false;
+        renderer->meshVersion = renderer->mesh->version;
+        return;
+    }
+
+    void* drawMapping = renderer->uploadMapping;
+    if (!GLEW_ARB_buffer_storage) {
+        glBindBuffer(GL_ARRAY_BUFFER, renderer->uploadVbo);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        drawMapping = NULL;
+    }
+
+    // Everything already submitted may still read the old buffer
+    renderer->uploadFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    GLuint spare = renderer->vbo;
+    renderer->vbo = renderer->uploadVbo;
+    renderer->uploadVbo = spare;
+    renderer->uploadMapping = renderer->vboMapping;
+    renderer->vboMapping = drawMapping;
+    renderer->uploadOpen = false;
+
+    recordVertexLayout(renderer);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // The GPU copy is now ahead of the mesh, don't let an old version overwrite it
+    renderer->meshVersion = renderer->mesh->version;
+}
+
+// Re-uploads the vertices if the mesh changed since the last upload
+static void syncMeshBuffers(Renderer* renderer)
+{
+    Mesh* mesh = renderer->mesh;
+    if (mesh->version == renderer->meshVersion)
+        return;
+
+    // Topology never changes, only vertex data is rewritten
+    uploadMeshVertices(renderer);
+
+    renderer->meshVersion = mesh->version;
+}
+
+GLuint createPassBuffer()
+{
+    GLuint passBuffer;
+    glGenBuffers(1, &passBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, passBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(PassData), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    glBindBufferBase(GL_UNIFORM_BUFFER, PASS_DATA_BINDING, passBuffer);
+
+    return passBuffer;
+}
+
+// Fills the PassData block shared by every draw of the pass
+void updatePassBuffer(GLuint passBuffer, Camera* camera, float* clipPlane)
+{
+    PassData passData;
+    memcpy(passData.view, camera->view, sizeof(passData.view));
+    memcpy(passData.projection, camera->projection, sizeof(passData.projection));
+    memcpy(passData.cameraPosition, camera->position, 3 * sizeof(float));
+    passData.cameraPosition[3] = 1.0f;
+
+    if (clipPlane != NULL)
+        memcpy(passData.clipPlane, clipPlane, sizeof(passData.clipPlane));
+    else
+        memset(passData.clipPlane, 0, sizeof(passData.clipPlane));
+
+    passData.time = (float)glfwGetTime();
+
+    glBindBuffer(GL_UNIFORM_BUFFER, passBuffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(PassData), &passData);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    glBindBufferBase(GL_UNIFORM_BUFFER, PASS_DATA_BINDING, passBuffer);
+}
+
+// Re-uploads the DrawData block only when the model matrix changed
+static void syncDrawBuffer(Renderer* renderer, float* model)
+{
+    if (memcmp(renderer->drawData.model, model, sizeof(renderer->drawData.model)) != 0) {
+        float normalMatrix[9];
+        setNormalMatrix(model, normalMatrix);
+
+        memcpy(renderer->drawData.model, model, sizeof(renderer->drawData.model));
+        for (int column = 0; column < 3; column++) {
+            renderer->drawData.normalMatrix[column * 4] = normalMatrix[column * 3];
+            renderer->drawData.normalMatrix[column * 4 + 1] = normalMatrix[column * 3 + 1];
+            renderer->drawData.normalMatrix[column * 4 + 2] = normalMatrix[column * 3 + 2];
+            renderer->drawData.normalMatrix[column * 4 + 3] = 0.0f;
+        }
+
+        glBindBuffer(GL_UNIFORM_BUFFER, renderer->drawUbo);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(DrawData), &renderer->drawData);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    glBindBufferBase(GL_UNIFORM_BUFFER, DRAW_DATA_BINDING, renderer->drawUbo);
+}
+
+void renderMesh(Renderer* renderer, float* model)
+{
+    syncMeshBuffers(renderer);
+    syncDrawBuffer(renderer, model);
+
+    glBindVertexArray(renderer->vao);
 
     // Render
     glUseProgram(renderer->shader->program);
@@ -82,71 +429,25 @@ void renderMesh(Renderer* renderer, float* model, Camera* camera, float* clipPla
         glBindTexture(GL_TEXTURE_2D, renderer->textures[4]);  // Bind the texture to GL_TEXTURE_2D target
     }
 
-    GLint viewLoc = glGetUniformLocation(renderer->shader->program, "view");
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, camera->view);
-
-    GLint projLoc = glGetUniformLocation(renderer->shader->program, "projection");
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, camera->projection);
-
-    glBindVertexArray(renderer->vao);
-
-    GLint modelLoc = glGetUniformLocation(renderer->shader->program, "model");
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, model);
-
-    viewLoc = glGetUniformLocation(renderer->shader->program, "view");
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, camera->view);
-
-    projLoc = glGetUniformLocation(renderer->shader->program, "projection");
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, camera->projection);
+    if (renderer->vertexFormat == VERTEX_FORMAT_HEIGHT_TEXTURE) {
+        glActiveTexture(GL_TEXTURE0 + HEIGHT_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_2D, renderer->heightTexture);
 
-    GLint cameraPositionLoc = glGetUniformLocation(renderer->shader->program, "cameraPosition");
-    glUniform3fv(cameraPositionLoc, 1, camera->position); 
-
-    GLint clipPlaneLoc = glGetUniformLocation(renderer->shader->program, "clipPlane");
-    if (clipPlaneLoc != -1 && clipPlane != NULL)
-        glUniform4fv(clipPlaneLoc, 1, clipPlane);
-
-    GLint reflectionTextureLoc = glGetUniformLocation(renderer->shader->program, "reflectionTexture");
-    glUniform1i(reflectionTextureLoc, 0);
-
-    GLint refractionTextureLoc = glGetUniformLocation(renderer->shader->program, "refractionTexture");
-    glUniform1i(refractionTextureLoc, 1);
-
-    GLint duDvTextureLoc = glGetUniformLocation(renderer->shader->program, "duDvTexture");
-    glUniform1i(duDvTextureLoc, 2);
-
-    GLint normalTextureLoc = glGetUniformLocation(renderer->shader->program, "normalMap");
-    glUniform1i(normalTextureLoc, 3);
-
-    GLint depthTextureLoc = glGetUniformLocation(renderer->shader->program, "depthMap");
-    glUniform1i(depthTextureLoc, 4);
+        glActiveTexture(GL_TEXTURE0 + NORMAL_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_2D, renderer->normalTexture);
+    }
 
-    GLint timeLoc = glGetUniformLocation(renderer->shader->program, "time");
-    glUniform1f(timeLoc, glfwGetTime());
+    // Camera, clip plane and time come from the PassData block, the model from DrawData
+    // Sampler units are assigned once in createShader
 
     glDrawElements(GL_TRIANGLES, renderer->mesh->indexCount, GL_UNSIGNED_INT, 0);
 }
 
 void renderUI(Renderer* renderer, float* offset, float* scale)
 {
-    // Generate and bind a VAO for each terrain chunk
-    glBindVertexArray(renderer->vao);
+    syncMeshBuffers(renderer);
 
-    // Create a Vertex Buffer Object and copy the vertex data to it
-    glBindBuffer(GL_ARRAY_BUFFER, renderer->vbo[0]);
-    glBufferData(GL_ARRAY_BUFFER, renderer->mesh->vertexCount * 5 * sizeof(GLfloat), renderer->mesh->vertices, GL_STATIC_DRAW);
-
-    GLint positionAttribute = glGetAttribLocation(renderer->shader->program, "position");
-    glVertexAttribPointer(positionAttribute, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), 0);
-    glEnableVertexAttribArray(positionAttribute);
-
-    GLint textureAttribute = glGetAttribLocation(renderer->shader->program, "texCoord");
-    glVertexAttribPointer(textureAttribute, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (void*)(3 * sizeof(GLfloat)));
-    glEnableVertexAttribArray(textureAttribute);
-
-    // Create an Element Buffer Object and copy the index data to it
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, renderer->ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, renderer->mesh->indexCount * sizeof(GLuint), renderer->mesh->indices, GL_STATIC_DRAW);
+    glBindVertexArray(renderer->vao);
 
     // Render
     glUseProgram(renderer->shader->program);
@@ -154,22 +455,29 @@ void renderUI(Renderer* renderer, float* offset, float* scale)
     if (renderer->texturesCount > 0) {
         glActiveTexture(GL_TEXTURE0);  // Activate the texture unit
         glBindTexture(GL_TEXTURE_2D, renderer->textures[0]);  // Bind the texture to GL_TEXTURE_2D target
-        GLint mainTextureLoc = glGetUniformLocation(renderer->shader->program, "mainTexture");
-        glUniform1i(mainTextureLoc, GL_TEXTURE0);
     }
 
-    GLint offsetLoc = glGetUniformLocation(renderer->shader->program, "offset");
-    glUniform2fv(offsetLoc, 1, offset);
+    GLint* uniforms = renderer->shader->uniforms;
+
+    if (uniforms[UNIFORM_OFFSET] != -1)
+        glUniform2fv(uniforms[UNIFORM_OFFSET], 1, offset);
 
-    GLint scaleLoc = glGetUniformLocation(renderer->shader->program, "scale");
-    glUniform2fv(scaleLoc, 1, scale);
+    if (uniforms[UNIFORM_SCALE] != -1)
+        glUniform2fv(uniforms[UNIFORM_SCALE], 1, scale);
 
     glDrawElements(GL_TRIANGLES, renderer->mesh->indexCount, GL_UNSIGNED_INT, 0);
 }
 
 void cleanRenderer(Renderer* renderer)
 {
+    waitFence(&renderer->uploadFence);
+    if (renderer->uploadVbo != 0)
+        glDeleteBuffers(1, &renderer->uploadVbo); // Deleting a buffer unmaps it
+
     glDeleteBuffers(1, &renderer->vbo);
     glDeleteBuffers(1, &renderer->ebo);
+    glDeleteBuffers(1, &renderer->drawUbo);
     glDeleteVertexArrays(1, &renderer->vao);
+    glDeleteTextures(1, &renderer->heightTexture);
+    glDeleteTextures(1, &renderer->normalTexture);
 }
\ No newline at end of file
@@ -1,21 +1,54 @@
 #pragma once
 
 #include <GL/glew.h>
+#include <stdbool.h>
 #include "mesh.h"
 #include "shader.h"
 #include "camera.h"
 
+// std140 layout of the PassData uniform block
+typedef struct {
+    float view[16];
+    float projection[16];
+    float cameraPosition[4];
+    float clipPlane[4];
+    float time;
+    float padding[3];
+} PassData;
+
+// std140 layout of the DrawData uniform block
+typedef struct {
+    float model[16];
+    float normalMatrix[12]; // mat3 columns are padded to vec4 in std140
+} DrawData;
+
 typedef struct {
     GLuint vao;
-    GLuint vbo[2]; // 0 - Vertices Array, 1 - Normals Array
+    GLuint vbo; // Interleaved vertices in vertexFormat, 0 for VERTEX_FORMAT_HEIGHT_TEXTURE
+    VertexFormat vertexFormat;
+    void* vboMapping;     // Persistent mapping of vbo once it took over from uploadVbo, NULL for a plain buffer
+    GLuint uploadVbo;     // Spare vertex buffer generated vertices are written into, 0 until the first upload
+    void* uploadMapping;  // Writable view of uploadVbo, kept mapped for good with ARB_buffer_storage
+    bool uploadOpen;      // uploadMapping was handed out and not yet swapped in
+    GLsync uploadFence;   // Passes once the GPU finished the draws or texture copies that last read uploadVbo
+    GLuint heightTexture; // VERTEX_FORMAT_HEIGHT_TEXTURE only, one R32F texel per grid vertex
+    GLuint normalTexture; // VERTEX_FORMAT_HEIGHT_TEXTURE only, octahedral normals as RG16 snorm
     GLuint ebo;
+    int meshVersion; // Mesh version currently resident in the GPU buffers
+    GLuint drawUbo;
+    DrawData drawData; // Last per-draw constants uploaded to drawUbo
     Mesh* mesh;
     Shader* shader;
     GLint* textures;
     int texturesCount;
 } Renderer;
 
-Renderer* createRenderer(Mesh* mesh, Shader* shader, GLuint* textures, int texturesCount);
-void renderMesh(Renderer* renderer, float* model, Camera* camera, float* clipPlane);
+Renderer* createRenderer(Mesh* mesh, Shader* shader, GLuint* textures, int texturesCount, VertexFormat vertexFormat);
+void setRendererMesh(Renderer* renderer, Mesh* mesh);
+void* beginRendererUpload(Renderer* renderer);
+void endRendererUpload(Renderer* renderer);
+GLuint createPassBuffer();
+void updatePassBuffer(GLuint passBuffer, Camera* camera, float* clipPlane);
+void renderMesh(Renderer* renderer, float* model);
 void renderUI(Renderer* renderer, float* offset, float* scale);
 void cleanRenderer(Renderer* renderer);
\ No newline at end of file
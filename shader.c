@@ -2,50 +2,215 @@
 
 #include "stdlib.h"
 #include "stdio.h"
+#include "string.h"
 
+#include "chunk.h"
+#include "mesh.h"
 #include "util.h"
 
-Shader* createShader(char* vertexShaderPath, char* fragmentShaderPath)
+#define STRINGIFY(x) #x
+#define EXPAND_STRINGIFY(x) STRINGIFY(x)
+
+// Functions shared by the stages, spliced in after shaderDefines
+#define SHADER_COMMON_PATH "shaders/common.glsl"
+
+// Spliced in after the #version line of every stage so the shaders use the engine's values instead of copies
+static const char* shaderDefines =
+    "#define PACKED_HEIGHT_MIN " EXPAND_STRINGIFY(PACKED_HEIGHT_MIN) "\n"
+    "#define PACKED_HEIGHT_STEP " EXPAND_STRINGIFY(PACKED_HEIGHT_STEP) "\n"
+    "#define CHUNK_WIDTH " EXPAND_STRINGIFY(CHUNK_WIDTH) "\n"
+    "#define CHUNK_LENGTH " EXPAND_STRINGIFY(CHUNK_LENGTH) "\n";
+
+typedef struct {
+    const char* name;
+    GLint textureUnit; // Samplers are bound to a fixed unit at link time, -1 for other uniforms
+} UniformInfo;
+
+// Indexed by ShaderUniform
+static const UniformInfo uniformInfos[UNIFORM_COUNT] = {
+    { "offset", -1 },
+    { "scale", -1 },
+    { "lightDir", -1 },
+    { "lightColor", -1 },
+    { "mainTexture", 0 },
+    { "reflectionTexture", 0 },
+    { "refractionTexture", 1 },
+    { "duDvTexture", 2 },
+    { "normalMap", 3 },
+    { "depthMap", 4 },
+    { "heightTexture", HEIGHT_TEXTURE_UNIT },
+    { "normalTexture", NORMAL_TEXTURE_UNIT },
+};
+
+// Indexed by ShaderAttribute
+static const char* attributeNames[ATTRIBUTE_COUNT] = {
+    "position",
+    "texCoord",
+    "normal",
+    "vertex",
+};
+
+static void reflectUniforms(Shader* shader, const char* programName)
 {
-    Shader* shader = (Shader*) malloc(sizeof(Shader));
-    if (shader == NULL)
-        return NULL;
+    for (int i = 0; i < UNIFORM_COUNT; i++)
+        shader->uniforms[i] = -1;
 
-    // Create and compile the vertex shader
-    shader->vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    const GLchar* vertexSource = readFileToString(vertexShaderPath);
-    glShaderSource(shader->vertexShader, 1, &vertexSource, NULL);
-    glCompileShader(shader->vertexShader);
+    GLint uniformCount;
+    glGetProgramiv(shader->program, GL_ACTIVE_UNIFORMS, &uniformCount);
 
-    // Check for compile errors
-    GLint status;
-    glGetShaderiv(shader->vertexShader, GL_COMPILE_STATUS, &status);
-    if (status != GL_TRUE) {
-        char buffer[512];
-        glGetShaderInfoLog(shader->vertexShader, 512, NULL, buffer);
-        fprintf(stderr, "Vertex Shader Compile Error: %s\n", buffer);
+    glUseProgram(shader->program);
+
+    for (GLuint i = 0; i < (GLuint)uniformCount; i++) {
+        char name[128];
+        GLint size;
+        GLenum type;
+        glGetActiveUniform(shader->program, i, sizeof(name), NULL, &size, &type, name);
+
+        // Members of uniform blocks are fed through the block's buffer
+        GLint blockIndex;
+        glGetActiveUniformsiv(shader->program, 1, &i, GL_UNIFORM_BLOCK_INDEX, &blockIndex);
+        if (blockIndex != -1)
+            continue;
+
+        // Arrays are reported as "name[0]"
+        char* bracket = strchr(name, '[');
+        if (bracket != NULL)
+            *bracket = '\0';
+
+        int slot = -1;
+        for (int j = 0; j < UNIFORM_COUNT; j++) {
+            if (strcmp(name, uniformInfos[j].name) == 0) {
+                slot = j;
+                break;
+            }
+        }
+
+        if (slot == -1) {
+            fprintf(stderr, "Shader %s: uniform '%s' has no slot in the uniform table and will never be set\n", programName, name);
+            continue;
+        }
+
+        shader->uniforms[slot] = glGetUniformLocation(shader->program, name);
+
+        if (uniformInfos[slot].textureUnit != -1)
+            glUniform1i(shader->uniforms[slot], uniformInfos[slot].textureUnit);
+    }
+
+    glUseProgram(0);
+}
+
+static void bindUniformBlock(Shader* shader, const char* blockName, GLuint binding)
+{
+    GLuint blockIndex = glGetUniformBlockIndex(shader->program, blockName);
+    if (blockIndex != GL_INVALID_INDEX)
+        glUniformBlockBinding(shader->program, blockIndex, binding);
+}
+
+static void reflectAttributes(Shader* shader, const char* programName)
+{
+    for (int i = 0; i < ATTRIBUTE_COUNT; i++)
+        shader->attributes[i] = -1;
+
+    GLint attributeCount;
+    glGetProgramiv(shader->program, GL_ACTIVE_ATTRIBUTES, &attributeCount);
+
+    for (GLuint i = 0; i < (GLuint)attributeCount; i++) {
+        char name[128];
+        GLint size;
+        GLenum type;
+        glGetActiveAttrib(shader->program, i, sizeof(name), NULL, &size, &type, name);
+
+        // Built-ins such as gl_VertexID are reported as active attributes too
+        if (strncmp(name, "gl_", 3) == 0)
+            continue;
+
+        int slot = -1;
+        for (int j = 0; j < ATTRIBUTE_COUNT; j++) {
+            if (strcmp(name, attributeNames[j]) == 0) {
+                slot = j;
+                break;
+            }
+        }
+
+        if (slot == -1) {
+            fprintf(stderr, "Shader %s: attribute '%s' has no slot in the attribute table and will never be fed\n", programName, name);
+            continue;
+        }
+
+        shader->attributes[slot] = glGetAttribLocation(shader->program, name);
     }
+}
+
+// Creates and compiles one stage, with shaderDefines and the common source inserted after its #version line
+static GLuint compileStage(GLenum type, const char* path, const char* stageName)
+{
+    GLuint stage = glCreateShader(type);
 
-    // Create and compile the fragment shader
-    shader->fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    const GLchar* fragmentSource = readFileToString(fragmentShaderPath);
-    glShaderSource(shader->fragmentShader, 1, &fragmentSource, NULL);
-    glCompileShader(shader->fragmentShader);
+    char* source = readFileToString(path);
+    if (source == NULL)
+        return stage;
+
+    // #version must stay the first line, the rest of the file keeps its line numbers in compile errors
+    const char* body = source;
+    if (strncmp(source, "#version", 8) == 0) {
+        const char* newline = strchr(source, '\n');
+        body = newline != NULL ? newline + 1 : source + strlen(source);
+    }
+
+    char* common = readFileToString(SHADER_COMMON_PATH);
+
+    const char* lineDirective = body != source ? "#line 2\n" : "#line 1\n";
+    const GLchar* sources[5] = { source, shaderDefines, common != NULL ? common : "", lineDirective, body };
+    const GLint lengths[5] = { (GLint)(body - source), -1, -1, -1, -1 };
+    glShaderSource(stage, 5, sources, lengths);
+    glCompileShader(stage);
+
+    free(common);
+    free(source);
 
     // Check for compile errors
-    glGetShaderiv(shader->fragmentShader, GL_COMPILE_STATUS, &status);
+    GLint status;
+    glGetShaderiv(stage, GL_COMPILE_STATUS, &status);
     if (status != GL_TRUE) {
         char buffer[512];
-        glGetShaderInfoLog(shader->fragmentShader, 512, NULL, buffer);
-        fprintf(stderr, "Fragment Shader Compile Error: %s\n", buffer);
+        glGetShaderInfoLog(stage, 512, NULL, buffer);
+        fprintf(stderr, "%s Shader Compile Error (%s): %s\n", stageName, path, buffer);
     }
 
+    return stage;
+}
+
+Shader* createShader(char* vertexShaderPath, char* fragmentShaderPath)
+{
+    Shader* shader = (Shader*) malloc(sizeof(Shader));
+    if (shader == NULL)
+        return NULL;
+
+    shader->vertexShader = compileStage(GL_VERTEX_SHADER, vertexShaderPath, "Vertex");
+    shader->fragmentShader = compileStage(GL_FRAGMENT_SHADER, fragmentShaderPath, "Fragment");
+
     // Link the vertex and fragment shader into a shader program
     shader->program = glCreateProgram();
     glAttachShader(shader->program, shader->vertexShader);
     glAttachShader(shader->program, shader->fragmentShader);
     glLinkProgram(shader->program);
 
+    // Check for link errors
+    GLint status;
+    glGetProgramiv(shader->program, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE) {
+        char buffer[512];
+        glGetProgramInfoLog(shader->program, 512, NULL, buffer);
+        fprintf(stderr, "Shader Program Link Error: %s\n", buffer);
+    }
+
+    // Resolve uniform and attribute locations once instead of on every draw
+    reflectUniforms(shader, vertexShaderPath);
+    reflectAttributes(shader, vertexShaderPath);
+
+    bindUniformBlock(shader, "PassData", PASS_DATA_BINDING);
+    bindUniformBlock(shader, "DrawData", DRAW_DATA_BINDING);
+
     return shader;
 }
 
@@ -2,10 +2,46 @@
 
 #include <GL/glew.h>
 
+// Fixed binding points of the std140 uniform blocks shared by all shaders
+#define PASS_DATA_BINDING 0 // PassData: camera matrices, clip plane and time, filled once per pass
+#define DRAW_DATA_BINDING 1 // DrawData: model and normal matrix, filled once per draw
+
+// Texture units of the height and normal textures a VERTEX_FORMAT_HEIGHT_TEXTURE renderer draws from,
+// past the ones the renderer's own textures use
+#define HEIGHT_TEXTURE_UNIT 5
+#define NORMAL_TEXTURE_UNIT 6
+
+// Uniforms the renderers know how to set, resolved once when the program is linked
+typedef enum {
+	UNIFORM_OFFSET,
+	UNIFORM_SCALE,
+	UNIFORM_LIGHT_DIR,
+	UNIFORM_LIGHT_COLOR,
+	UNIFORM_MAIN_TEXTURE,
+	UNIFORM_REFLECTION_TEXTURE,
+	UNIFORM_REFRACTION_TEXTURE,
+	UNIFORM_DUDV_TEXTURE,
+	UNIFORM_NORMAL_MAP,
+	UNIFORM_DEPTH_MAP,
+	UNIFORM_HEIGHT_TEXTURE,
+	UNIFORM_NORMAL_TEXTURE,
+	UNIFORM_COUNT
+} ShaderUniform;
+
+typedef enum {
+	ATTRIBUTE_POSITION,
+	ATTRIBUTE_TEX_COORD,
+	ATTRIBUTE_NORMAL,
+	ATTRIBUTE_VERTEX,
+	ATTRIBUTE_COUNT
+} ShaderAttribute;
+
 typedef struct {
 	GLuint program;
 	GLuint vertexShader;
 	GLuint fragmentShader;
+	GLint uniforms[UNIFORM_COUNT];     // -1 if the program has no such active uniform
+	GLint attributes[ATTRIBUTE_COUNT]; // -1 if the program has no such active attribute
 } Shader;
 
 Shader* createShader(char* vertexShaderPath, char* fragmentShaderPath);
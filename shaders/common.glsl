@@ -0,0 +1,33 @@
+// Shared by every stage, createShader inserts this after the #version line and the engine's #defines
+
+// Inverse of the octahedral encoding around +y used for PackedVertex and the normal texture
+vec3 decodeNormal(vec2 encoded) {
+    vec3 n = vec3(encoded.x, 1.0 - abs(encoded.x) - abs(encoded.y), encoded.y);
+    if (n.y < 0.0)
+        n.xz = (1.0 - abs(n.zx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.z >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+
+vec3 interpolateColors(vec3 color1, vec3 color2, float factor) {
+    return mix(color1, color2, factor);
+}
+
+// Biome color for a terrain height, h is the height divided by 150
+vec3 biomeColor(float h) {
+    if (h < 0.2)
+        return vec3(0.0, 0.0, 1.0);  // Deep ocean
+    else if (h < 0.3)
+        return interpolateColors(vec3(0.0, 0.0, 1.0), vec3(0.5, 0.5, 1.0), (h - 0.2) / 0.2);  // Deep to Shallow ocean
+    else if (h < 0.4)
+        return interpolateColors(vec3(0.5, 0.5, 1.0), vec3(1.0, 0.8, 0.0), (h - 0.3) / 0.1);  // Shallow ocean to Beach
+    else if (h < 0.5)
+        return interpolateColors(vec3(1.0, 0.8, 0.0), vec3(0.5, 1.0, 0.5), (h - 0.4) / 0.1);  // Beach to Plains
+    else if (h < 0.7)
+        return interpolateColors(vec3(0.5, 1.0, 0.5), vec3(0.0, 0.5, 0.0), (h - 0.5) / 0.2);  // Plains to Hill
+    else if (h < 0.75)
+        return interpolateColors(vec3(0.0, 0.5, 0.0), vec3(0.6, 0.3, 0.1), (h - 0.7) / 0.05);  // Hill to Mountain
+    else if (h < 0.9)
+        return interpolateColors(vec3(0.6, 0.3, 0.1), vec3(1.0, 1.0, 1.0), (h - 0.75) / 0.15);  // Mountain to Snow
+    else
+        return vec3(1.0, 1.0, 1.0);  // Snow
+}
@@ -0,0 +1,46 @@
+#version 450 core
+
+// Terrain without vertex attributes: the grid position follows from the vertex index,
+// height and normal are fetched from the textures the renderer keeps per grid vertex
+
+out vec3 Color;
+out vec2 TexCoord;
+out vec3 Normal;
+
+layout(std140) uniform PassData {
+    mat4 view;
+    mat4 projection;
+    vec4 cameraPosition;
+    vec4 clipPlane;
+    float time;
+};
+
+layout(std140) uniform DrawData {
+    mat4 model;
+    mat3 normalMatrix; // Inverse transpose of the model, computed on the CPU
+};
+
+uniform sampler2D heightTexture; // R32F
+uniform sampler2D normalTexture; // RG16 snorm, octahedral encoded around +y
+
+void main()
+{
+    ivec2 gridSize = textureSize(heightTexture, 0);
+    ivec2 cell = ivec2(gl_VertexID % gridSize.x, gl_VertexID / gridSize.x);
+
+    vec3 position = vec3(cell.x, texelFetch(heightTexture, cell, 0).r, cell.y);
+
+    float h = position.y / 150;
+
+    const vec4 worldLocation = model * vec4(position, 1.0);
+
+    gl_ClipDistance[0] = dot(worldLocation, clipPlane);
+
+    Color = biomeColor(h);
+
+    Normal = normalize(normalMatrix * decodeNormal(texelFetch(normalTexture, cell, 0).rg));
+
+    TexCoord = vec2(cell) / vec2(gridSize - 1);
+
+    gl_Position = projection * view * worldLocation;
+}
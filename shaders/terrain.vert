@@ -1,22 +1,28 @@
 #version 450 core
 
+// PackedVertex: grid x, grid z and the quantized height, then the octahedral normal
 in vec3 position;
-in vec2 texCoord;
-in vec3 normal;
+in vec2 normal;
 
 out vec3 Color;
 out vec2 TexCoord;
 out vec3 Normal;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+layout(std140) uniform PassData {
+    mat4 view;
+    mat4 projection;
+    vec4 cameraPosition;
+    vec4 clipPlane;
+    float time;
+};
 
-uniform vec4 clipPlane;
+layout(std140) uniform DrawData {
+    mat4 model;
+    mat3 normalMatrix; // Inverse transpose of the model, computed on the CPU
+};
 
-vec3 interpolateColors(vec3 color1, vec3 color2, float factor) {
-    return mix(color1, color2, factor);
-}
+// PACKED_HEIGHT_MIN, PACKED_HEIGHT_STEP, CHUNK_WIDTH and CHUNK_LENGTH are defined by createShader from mesh.h and chunk.h
+const vec2 gridSize = vec2(CHUNK_WIDTH - 1, CHUNK_LENGTH - 1);
 
 float squishHeight(float h) {
     if (h >= 0.25 && h <= 0.7) {
@@ -27,33 +33,19 @@ float squishHeight(float h) {
 
 void main()
 {
-    float h = position.y / 150;
+    vec3 vertexPosition = vec3(position.x, PACKED_HEIGHT_MIN + position.z * PACKED_HEIGHT_STEP, position.y);
+
+    float h = vertexPosition.y / 150;
 
-    const vec4 worldLocation = model * vec4(position, 1.0);
+    const vec4 worldLocation = model * vec4(vertexPosition, 1.0);
 
     gl_ClipDistance[0] = dot(worldLocation, clipPlane);
 
-    if (h < 0.2)
-        Color = vec3(0.0, 0.0, 1.0);  // Deep ocean
-    else if (h < 0.3)
-        Color = interpolateColors(vec3(0.0, 0.0, 1.0), vec3(0.5, 0.5, 1.0), (h - 0.2) / 0.2);  // Deep to Shallow ocean
-    else if (h < 0.4)
-        Color = interpolateColors(vec3(0.5, 0.5, 1.0), vec3(1.0, 0.8, 0.0), (h - 0.3) / 0.1);  // Shallow ocean to Beach
-    else if (h < 0.5)
-        Color = interpolateColors(vec3(1.0, 0.8, 0.0), vec3(0.5, 1.0, 0.5), (h - 0.4) / 0.1);  // Beach to Plains
-    else if (h < 0.7)
-        Color = interpolateColors(vec3(0.5, 1.0, 0.5), vec3(0.0, 0.5, 0.0), (h - 0.5) / 0.2);  // Plains to Hill
-    else if (h < 0.75)
-        Color = interpolateColors(vec3(0.0, 0.5, 0.0), vec3(0.6, 0.3, 0.1), (h - 0.7) / 0.05);  // Hill to Mountain
-    else if (h < 0.9)
-        Color = interpolateColors(vec3(0.6, 0.3, 0.1), vec3(1.0, 1.0, 1.0), (h - 0.75) / 0.15);  // Mountain to Snow
-    else
-        Color = vec3(1.0, 1.0, 1.0);  // Snow
-
-    mat3 normalMatrix = transpose(inverse(mat3(model)));
-    Normal = normalize(normalMatrix * normal);
-
-    TexCoord = texCoord;
+    Color = biomeColor(h);
+
+    Normal = normalize(normalMatrix * decodeNormal(normal));
+
+    TexCoord = position.xy / gridSize;
 
     gl_Position = projection * view * worldLocation;
 }
@@ -13,7 +13,13 @@ uniform sampler2D duDvTexture;
 uniform sampler2D normalMap; 
 uniform sampler2D depthMap; 
 
-uniform float time; 
+layout(std140) uniform PassData {
+    mat4 view;
+    mat4 projection;
+    vec4 cameraPosition;
+    vec4 clipPlane;
+    float time;
+};
 
 const float DISTORTION_SCALE = 0.01;
 const float WAVE_SPEED = 0.03;
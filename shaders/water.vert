@@ -8,12 +8,18 @@ out vec2 TexCoord;
 out vec3 toCameraVector;
 out vec3 fromLightVector;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform vec3 cameraPosition;
-
-uniform float time;
+layout(std140) uniform PassData {
+    mat4 view;
+    mat4 projection;
+    vec4 cameraPosition;
+    vec4 clipPlane;
+    float time;
+};
+
+layout(std140) uniform DrawData {
+    mat4 model;
+    mat3 normalMatrix;
+};
 
 vec3 lightDir = normalize(vec3(-1.0, -1.0, -1.0));
 
@@ -31,6 +37,6 @@ void main()
     gl_Position = clipSpace;
 
     TexCoord = texCoord * tiling;
-    toCameraVector = cameraPosition - worldPosition.xyz;
+    toCameraVector = cameraPosition.xyz - worldPosition.xyz;
     fromLightVector = worldPosition.xyz - lightDir;
 }
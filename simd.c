@@ -0,0 +1,32 @@
+#include "simd.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+
+// The CPU may support the instructions while the OS doesn't save the wide registers
+static bool osSavesState(unsigned long long mask)
+{
+    int info[4];
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    return osxsave && (_xgetbv(0) & mask) == mask;
+}
+
+bool cpuHasAvx2()
+{
+    // Leaf 7 holds the AVX2 bit, CPUs that don't report it answer with unrelated data
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0 && osSavesState(0x6);
+}
+#else
+bool cpuHasAvx2()
+{
+    return __builtin_cpu_supports("avx2");
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdbool.h>
+
+// Functions using AVX2 intrinsics must be marked so GCC/Clang emit them without
+// raising the baseline of the whole program. MSVC accepts the intrinsics anywhere.
+#ifdef _MSC_VER
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+bool cpuHasAvx2();
\ No newline at end of file
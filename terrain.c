@@ -3,22 +3,177 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include "noise.h"
+#include "noisegraph.h"
+#include "thread.h"
+#include "simd.h"
+#include "util.h"
 #include <time.h>
 #include <math.h>
+#include <immintrin.h>
 
-float* generateHeightMap(int width, int length, float heightAmplifier, long seed, float frequency, int depth, int* offset)
+typedef struct {
+    float* heightMap;
+    int width;
+    int length;
+    float heightAmplifier;
+    const NoiseGraph* graph; // Heights of the value path
+    const Noise* noise;      // Gradient noise of the normals path
+    float frequency;    // Per sample, already scaled by the LOD's spacing
+    int octaves;        // Octaves of depth that the sample spacing resolves
+    float octaveShare;  // Amplitude share of those octaves, 1 when none are culled
+    int* offset;
+    int lod;
+    float* normals; // NULL for graph heights only, otherwise gradient noise heights and their normals
+    volatile long failed; // Set by any band that couldn't be generated
+} HeightMapJob;
+
+// Rows per job. Every band interpolates its first lattice rows from scratch, so bands are
+// tall enough for the coarse octaves to reuse them across many rows.
+#define HEIGHTMAP_BAND_ROWS 32
+
+// Octaves with fewer samples than this per wavelength are skipped, 2 is the Nyquist limit
+#define HEIGHTMAP_MIN_WAVELENGTH 2.0f
+
+// Average normalized output of an octave, stands in for the octaves culled at coarse spacings
+#define GRADIENT_NOISE_MEAN 0.5f
+
+// Normals come straight from the noise derivatives. For a height field h(x, z) the
+// surface normal is (-dh/dx, 1, -dh/dz), normalized.
+static void generateHeightNormalRows(HeightMapJob* job, int firstRow, int lastRow)
+{
+    float* slopes = (float*)malloc(job->width * 2 * sizeof(float));
+    if (slopes == NULL) {
+        storeAtomic(&job->failed, 1);
+        return;
+    }
+
+    float* slopeX = slopes;
+    float* slopeZ = slopes + job->width;
+
+    for (int z = firstRow; z < lastRow; z++) {
+        float* heights = job->heightMap + z * job->width;
+        float* normals = job->normals + z * job->width * 3;
+        gradient2dRow(heights, slopeX, slopeZ, job->width, job->offset[0], z + job->offset[1], job->noise, job->frequency, job->octaves);
+
+        // Culled octaves contribute their mean height and no slope
+        float share = job->octaveShare;
+        float bias = share < 1.0f ? GRADIENT_NOISE_MEAN * (1.0f - share) : 0.0f;
+        float slopeScale = job->heightAmplifier * share;
+
+        if (share < 1.0f) {
+            for (int x = 0; x < job->width; x++)
+                heights[x] = (heights[x] * share + bias) * job->heightAmplifier;
+        }
+        else {
+            for (int x = 0; x < job->width; x++)
+                heights[x] *= job->heightAmplifier;
+        }
+
+        // The y component is 1, so the length never gets close to 0
+        for (int x = 0; x < job->width; x++) {
+            float normalX = -slopeX[x] * slopeScale;
+            float normalZ = -slopeZ[x] * slopeScale;
+            float inverseLength = 1.0f / sqrtf(normalX * normalX + 1.0f + normalZ * normalZ);
+            normals[x * 3] = normalX * inverseLength;
+            normals[x * 3 + 1] = inverseLength;
+            normals[x * 3 + 2] = normalZ * inverseLength;
+        }
+    }
+
+    free(slopes);
+}
+
+static void generateHeightRows(HeightMapJob* job, int firstRow, int lastRow)
+{
+    if (job->normals != NULL) {
+        generateHeightNormalRows(job, firstRow, lastRow);
+        return;
+    }
+
+    float* rows = job->heightMap + firstRow * job->width;
+    if (!evaluateNoiseGraph(job->graph, rows, job->width, lastRow - firstRow, job->offset[0], firstRow + job->offset[1], job->lod)) {
+        storeAtomic(&job->failed, 1);
+        return;
+    }
+
+    for (int i = 0; i < (lastRow - firstRow) * job->width; i++)
+        rows[i] *= job->heightAmplifier;
+}
+
+// Samples are 1 << lod units apart, frequency is per unit and offset counts samples
+static void beginHeightMapJob(HeightMapJob* job, float* heightMap, int width, int length, float heightAmplifier, int* offset, int lod)
+{
+    job->heightMap = heightMap;
+    job->width = width;
+    job->length = length;
+    job->heightAmplifier = heightAmplifier;
+    job->graph = NULL;
+    job->noise = NULL;
+    job->frequency = 0.0f;
+    job->octaves = 0;
+    job->octaveShare = 1.0f;
+    job->offset = offset;
+    job->lod = lod;
+    job->normals = NULL;
+    job->failed = 0;
+}
+
+static void generateHeightBand(void* context, int band)
+{
+    HeightMapJob* job = (HeightMapJob*)context;
+    int firstRow = band * HEIGHTMAP_BAND_ROWS;
+    int lastRow = firstRow + HEIGHTMAP_BAND_ROWS < job->length ? firstRow + HEIGHTMAP_BAND_ROWS : job->length;
+    generateHeightRows(job, firstRow, lastRow);
+}
+
+float* generateHeightMap(int width, int length, float heightAmplifier, const NoiseGraph* graph, int* offset, int lod)
+{
+    return generateHeightMapParallel(width, length, heightAmplifier, graph, offset, lod, NULL);
+}
+
+// Every sample only depends on its coordinates, so splitting rows across threads gives
+// the same bits as generating them serially. A NULL pool runs on the calling thread.
+// The graph culls octaves finer than the sample spacing, a lod n map costs a fraction of lod 0.
+// Returns NULL if the map can't be allocated or the graph can't be evaluated.
+float* generateHeightMapParallel(int width, int length, float heightAmplifier, const NoiseGraph* graph, int* offset, int lod, ThreadPool* pool)
 {
-    int vertexCount = width * length;
-    float* heightMap = (GLfloat*) calloc(vertexCount, sizeof(GLfloat));
+    float* heightMap = (GLfloat*) malloc(width * length * sizeof(GLfloat));
     if (heightMap == NULL)
         return NULL;
 
-    for (int z = 0; z < length; z++)
-    {
-        for (int x = 0; x < width; x++)
-        {
-            heightMap[z * width + x] = perlin2d(x + offset[0], z + offset[1], seed, frequency, depth) * heightAmplifier;
-        }
+    HeightMapJob job;
+    beginHeightMapJob(&job, heightMap, width, length, heightAmplifier, offset, lod);
+    job.graph = graph;
+    runJobs(pool, generateHeightBand, &job, (length + HEIGHTMAP_BAND_ROWS - 1) / HEIGHTMAP_BAND_ROWS);
+
+    if (loadAtomic(&job.failed)) {
+        free(heightMap);
+        return NULL;
+    }
+
+    return heightMap;
+}
+
+// Gradient noise heights, normals receives 3 floats per sample so the mesh can skip its
+// normal pass. Only valid as long as nothing reshapes the heights afterwards.
+float* generateHeightMapNormals(int width, int length, float heightAmplifier, const Noise* noise, float frequency, int depth, int* offset, int lod, float* normals, ThreadPool* pool)
+{
+    float* heightMap = (GLfloat*) malloc(width * length * sizeof(GLfloat));
+    if (heightMap == NULL)
+        return NULL;
+
+    HeightMapJob job;
+    beginHeightMapJob(&job, heightMap, width, length, heightAmplifier, offset, lod);
+    job.noise = noise;
+    job.frequency = frequency * (float)(1 << lod);
+    job.octaves = countResolvedOctaves(job.frequency, depth, HEIGHTMAP_MIN_WAVELENGTH);
+    job.octaveShare = job.octaves < depth ? octaveAmplitudeShare(job.octaves, depth) : 1.0f;
+    job.normals = normals;
+    runJobs(pool, generateHeightBand, &job, (length + HEIGHTMAP_BAND_ROWS - 1) / HEIGHTMAP_BAND_ROWS);
+
+    if (loadAtomic(&job.failed)) {
+        free(heightMap);
+        return NULL;
     }
 
     return heightMap;
@@ -35,6 +190,19 @@ float* generateHeightMap(int width, int length, float heightAmplifier, long seed
 #define GRAVITY 4.0f
 #define MAX_DROPLET_LIFETIME 100
 
+// Parallel erosion splits the map into tiles processed in four checkerboard phases.
+// Droplets stay within their tile plus a margin, so tiles of the same phase never
+// read or write overlapping cells: margin + brush reach + bilinear neighbour < half a tile.
+#define EROSION_TILE_SIZE 64
+#define EROSION_TILE_MARGIN (EROSION_TILE_SIZE / 2 - EROSION_RADIUS - 2)
+
+// Droplets advanced in lockstep by the AVX2 kernel
+#define DROPLET_PACKET_SIZE 8
+
+// Droplets per tile in one slice of progressive erosion, a multiple of the packet size
+// so slicing never splits a packet. A slice covers every tile of a phase.
+#define EROSION_SLICE_DROPLETS (DROPLET_PACKET_SIZE * 32)
+
 // Helper struct for holding height and gradient data
 typedef struct {
     float height;
@@ -44,84 +212,354 @@ typedef struct {
 
 // Function Prototypes
 HeightAndGradient calculateHeightAndGradient(float* heightMap, int width, int height, float posX, float posY);
+static float applyErosionBrush(float* heightMap, TerrainBrush* brush, int centreX, int centreY, float amountToErode);
+static void simulateDroplet(float* heightMap, int width, int height, TerrainBrush* brush, float posX, float posY, const int* bounds);
 
 // Erosion function
 float* erodeHeightMap(float* heightMap, int width, int height, TerrainBrush* brush) {
+    const int bounds[4] = { 0, 0, width - 1, height - 1 };
+
     // Erosion loop
     for (int iteration = 0; iteration < 100000; iteration++) {
-        float posX = (float)(rand() % width);
-        float posY = (float)(rand() % height);
-        float dirX = 0;
-        float dirY = 0;
-        float speed = 1.0f;
-        float water = 1.0f;
-        float sediment = 0.0f;
-
-        for (int lifetime = 0; lifetime < MAX_DROPLET_LIFETIME; lifetime++) {
-            int nodeX = (int)posX;
-            int nodeY = (int)posY;
-            int dropletIndex = nodeY * width + nodeX;
-
-            if (dropletIndex < 0 || dropletIndex >= width * height) {
-                printf("Error: dropletIndex out of bounds (%d)\n", dropletIndex);
-                break;
-            }
+        // Droplets sample the cell to their south east, so none may start on the last row or column
+        float posX = (float)(rand() % (width - 1));
+        float posY = (float)(rand() % (height - 1));
+        simulateDroplet(heightMap, width, height, brush, posX, posY, bounds);
+    }
 
-            HeightAndGradient heightAndGradient = calculateHeightAndGradient(heightMap, width, height, posX, posY);
+    return heightMap;
+}
 
-            // Update the droplet's direction and position
-            dirX = dirX * INERTIA - heightAndGradient.gradientX * (1 - INERTIA);
-            dirY = dirY * INERTIA - heightAndGradient.gradientY * (1 - INERTIA);
-            float len = sqrtf(dirX * dirX + dirY * dirY);
-            if (len != 0) {
-                dirX /= len;
-                dirY /= len;
-            }
-            posX += dirX;
-            posY += dirY;
+// Moves a single droplet until it evaporates or leaves bounds (minX, minY, maxX, maxY exclusive)
+static void simulateDroplet(float* heightMap, int width, int height, TerrainBrush* brush, float posX, float posY, const int* bounds) {
+    float dirX = 0;
+    float dirY = 0;
+    float speed = 1.0f;
+    float water = 1.0f;
+    float sediment = 0.0f;
+
+    for (int lifetime = 0; lifetime < MAX_DROPLET_LIFETIME; lifetime++) {
+        int nodeX = (int)posX;
+        int nodeY = (int)posY;
+        int dropletIndex = nodeY * width + nodeX;
+
+        if (dropletIndex < 0 || dropletIndex >= width * height) {
+            printf("Error: dropletIndex out of bounds (%d)\n", dropletIndex);
+            break;
+        }
 
-            if (posX < 0 || posX >= width - 1 || posY < 0 || posY >= height - 1) {
-                break;
-            }
+        HeightAndGradient heightAndGradient = calculateHeightAndGradient(heightMap, width, height, posX, posY);
 
-            // Find the droplet's new height and calculate the deltaHeight
-            float newHeight = calculateHeightAndGradient(heightMap, width, height, posX, posY).height;
-            float deltaHeight = newHeight - heightAndGradient.height;
+        // Update the droplet's direction and position
+        dirX = dirX * INERTIA - heightAndGradient.gradientX * (1 - INERTIA);
+        dirY = dirY * INERTIA - heightAndGradient.gradientY * (1 - INERTIA);
+        float len = sqrtf(dirX * dirX + dirY * dirY);
+        if (len != 0) {
+            dirX /= len;
+            dirY /= len;
+        }
+        posX += dirX;
+        posY += dirY;
 
-            // Calculate sediment capacity
-            float sedimentCapacity = fmaxf(-deltaHeight * speed * water * SEDIMENT_CAPACITY_FACTOR, MIN_SEDIMENT_CAPACITY);
+        if (posX < bounds[0] || posX >= bounds[2] || posY < bounds[1] || posY >= bounds[3]) {
+            break;
+        }
 
-            if (sediment > sedimentCapacity || deltaHeight > 0) {
-                float amountToDeposit = (deltaHeight > 0) ? fminf(deltaHeight, sediment) : (sediment - sedimentCapacity) * DEPOSIT_SPEED;
-                sediment -= amountToDeposit;
+        // Find the droplet's new height and calculate the deltaHeight
+        float newHeight = calculateHeightAndGradient(heightMap, width, height, posX, posY).height;
+        float deltaHeight = newHeight - heightAndGradient.height;
+
+        // Calculate sediment capacity
+        float sedimentCapacity = fmaxf(-deltaHeight * speed * water * SEDIMENT_CAPACITY_FACTOR, MIN_SEDIMENT_CAPACITY);
+
+        if (sediment > sedimentCapacity || deltaHeight > 0) {
+            float amountToDeposit = (deltaHeight > 0) ? fminf(deltaHeight, sediment) : (sediment - sedimentCapacity) * DEPOSIT_SPEED;
+            sediment -= amountToDeposit;
+
+            // Add the sediment to the four nodes of the current cell using bilinear interpolation
+            float cellOffsetX = posX - nodeX;
+            float cellOffsetY = posY - nodeY;
+            heightMap[dropletIndex] += amountToDeposit * (1 - cellOffsetX) * (1 - cellOffsetY);
+            heightMap[dropletIndex + 1] += amountToDeposit * cellOffsetX * (1 - cellOffsetY);
+            heightMap[dropletIndex + width] += amountToDeposit * (1 - cellOffsetX) * cellOffsetY;
+            heightMap[dropletIndex + width + 1] += amountToDeposit * cellOffsetX * cellOffsetY;
+        } else {
+            // Erode the terrain
+            float amountToErode = fminf((sedimentCapacity - sediment) * ERODE_SPEED, -deltaHeight);
+            sediment += applyErosionBrush(heightMap, brush, nodeX, nodeY, amountToErode);
+        }
 
+        // Update droplet's speed and water content
+        speed = sqrtf(speed * speed + deltaHeight * GRAVITY);
+        water *= (1 - EVAPORATE_SPEED);
+    }
+}
+
+// Bilinear height and gradient for 8 droplets, dead lanes read cell 0
+TARGET_AVX2 static __m256 gatherHeightAndGradient(const float* heightMap, int width, __m256 posX, __m256 posY, __m256 alive, __m256* gradientX, __m256* gradientY) {
+    const __m256 one = _mm256_set1_ps(1.0f);
+
+    __m256i coordX = _mm256_cvttps_epi32(posX);
+    __m256i coordY = _mm256_cvttps_epi32(posY);
+    __m256 x = _mm256_sub_ps(posX, _mm256_cvtepi32_ps(coordX));
+    __m256 y = _mm256_sub_ps(posY, _mm256_cvtepi32_ps(coordY));
+
+    __m256i nodeIndexNW = _mm256_add_epi32(_mm256_mullo_epi32(coordY, _mm256_set1_epi32(width)), coordX);
+    nodeIndexNW = _mm256_and_si256(nodeIndexNW, _mm256_castps_si256(alive));
+
+    __m256 heightNW = _mm256_i32gather_ps(heightMap, nodeIndexNW, 4);
+    __m256 heightNE = _mm256_i32gather_ps(heightMap + 1, nodeIndexNW, 4);
+    __m256 heightSW = _mm256_i32gather_ps(heightMap + width, nodeIndexNW, 4);
+    __m256 heightSE = _mm256_i32gather_ps(heightMap + width + 1, nodeIndexNW, 4);
+
+    __m256 invX = _mm256_sub_ps(one, x);
+    __m256 invY = _mm256_sub_ps(one, y);
+
+    *gradientX = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(heightNE, heightNW), invY), _mm256_mul_ps(_mm256_sub_ps(heightSE, heightSW), y));
+    *gradientY = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(heightSW, heightNW), invX), _mm256_mul_ps(_mm256_sub_ps(heightSE, heightNE), x));
+
+    __m256 top = _mm256_add_ps(_mm256_mul_ps(heightNW, invX), _mm256_mul_ps(heightNE, x));
+    __m256 bottom = _mm256_add_ps(_mm256_mul_ps(heightSW, invX), _mm256_mul_ps(heightSE, x));
+    return _mm256_add_ps(_mm256_mul_ps(top, invY), _mm256_mul_ps(bottom, y));
+}
+
+// Same physics as simulateDroplet for a packet of droplets, count <= DROPLET_PACKET_SIZE.
+// Movement and sediment math run in SIMD lanes; heightmap writes are applied lane by lane
+// in lane order, so droplets of a packet that touch the same cells resolve deterministically.
+TARGET_AVX2 static void simulateDropletPacket(float* heightMap, int width, TerrainBrush* brush, const float* startX, const float* startY, int count, const int* bounds) {
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 minX = _mm256_set1_ps((float)bounds[0]);
+    const __m256 minY = _mm256_set1_ps((float)bounds[1]);
+    const __m256 maxX = _mm256_set1_ps((float)bounds[2]);
+    const __m256 maxY = _mm256_set1_ps((float)bounds[3]);
+
+    __m256 posX = _mm256_loadu_ps(startX);
+    __m256 posY = _mm256_loadu_ps(startY);
+    __m256 dirX = zero;
+    __m256 dirY = zero;
+    __m256 speed = one;
+    __m256 water = one;
+    __m256 sediment = zero;
+
+    // Lanes past count start dead
+    __m256i laneIndices = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256 alive = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(count), laneIndices));
+
+    for (int lifetime = 0; lifetime < MAX_DROPLET_LIFETIME; lifetime++) {
+        __m256i nodeX = _mm256_cvttps_epi32(posX);
+        __m256i nodeY = _mm256_cvttps_epi32(posY);
+
+        __m256 gradientX, gradientY;
+        __m256 oldHeight = gatherHeightAndGradient(heightMap, width, posX, posY, alive, &gradientX, &gradientY);
+
+        // Update the droplets' direction and position
+        dirX = _mm256_sub_ps(_mm256_mul_ps(dirX, _mm256_set1_ps(INERTIA)), _mm256_mul_ps(gradientX, _mm256_set1_ps(1 - INERTIA)));
+        dirY = _mm256_sub_ps(_mm256_mul_ps(dirY, _mm256_set1_ps(INERTIA)), _mm256_mul_ps(gradientY, _mm256_set1_ps(1 - INERTIA)));
+        __m256 len = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(dirX, dirX), _mm256_mul_ps(dirY, dirY)));
+        __m256 nonZero = _mm256_cmp_ps(len, zero, _CMP_NEQ_OQ);
+        dirX = _mm256_blendv_ps(dirX, _mm256_div_ps(dirX, len), nonZero);
+        dirY = _mm256_blendv_ps(dirY, _mm256_div_ps(dirY, len), nonZero);
+        posX = _mm256_add_ps(posX, dirX);
+        posY = _mm256_add_ps(posY, dirY);
+
+        // Droplets leaving bounds die before touching the map
+        __m256 inside = _mm256_and_ps(
+            _mm256_and_ps(_mm256_cmp_ps(posX, minX, _CMP_GE_OQ), _mm256_cmp_ps(posX, maxX, _CMP_LT_OQ)),
+            _mm256_and_ps(_mm256_cmp_ps(posY, minY, _CMP_GE_OQ), _mm256_cmp_ps(posY, maxY, _CMP_LT_OQ)));
+        alive = _mm256_and_ps(alive, inside);
+
+        int aliveBits = _mm256_movemask_ps(alive);
+        if (aliveBits == 0)
+            break;
+
+        // Find the droplets' new height and calculate the deltaHeight
+        __m256 unusedX, unusedY;
+        __m256 newHeight = gatherHeightAndGradient(heightMap, width, posX, posY, alive, &unusedX, &unusedY);
+        __m256 deltaHeight = _mm256_sub_ps(newHeight, oldHeight);
+
+        // Calculate sediment capacity
+        __m256 sedimentCapacity = _mm256_max_ps(
+            _mm256_mul_ps(_mm256_mul_ps(_mm256_sub_ps(zero, deltaHeight), speed), _mm256_mul_ps(water, _mm256_set1_ps(SEDIMENT_CAPACITY_FACTOR))),
+            _mm256_set1_ps(MIN_SEDIMENT_CAPACITY));
+
+        __m256 uphill = _mm256_cmp_ps(deltaHeight, zero, _CMP_GT_OQ);
+        __m256 deposit = _mm256_or_ps(_mm256_cmp_ps(sediment, sedimentCapacity, _CMP_GT_OQ), uphill);
+        __m256 amountToDeposit = _mm256_blendv_ps(
+            _mm256_mul_ps(_mm256_sub_ps(sediment, sedimentCapacity), _mm256_set1_ps(DEPOSIT_SPEED)),
+            _mm256_min_ps(deltaHeight, sediment), uphill);
+        __m256 amountToErode = _mm256_min_ps(
+            _mm256_mul_ps(_mm256_sub_ps(sedimentCapacity, sediment), _mm256_set1_ps(ERODE_SPEED)),
+            _mm256_sub_ps(zero, deltaHeight));
+
+        // Scatter phase, one lane at a time
+        float laneSediment[DROPLET_PACKET_SIZE], laneDeposit[DROPLET_PACKET_SIZE], laneErode[DROPLET_PACKET_SIZE];
+        float lanePosX[DROPLET_PACKET_SIZE], lanePosY[DROPLET_PACKET_SIZE];
+        int laneNodeX[DROPLET_PACKET_SIZE], laneNodeY[DROPLET_PACKET_SIZE];
+        _mm256_storeu_ps(laneSediment, sediment);
+        _mm256_storeu_ps(laneDeposit, amountToDeposit);
+        _mm256_storeu_ps(laneErode, amountToErode);
+        _mm256_storeu_ps(lanePosX, posX);
+        _mm256_storeu_ps(lanePosY, posY);
+        _mm256_storeu_si256((__m256i*)laneNodeX, nodeX);
+        _mm256_storeu_si256((__m256i*)laneNodeY, nodeY);
+        int depositBits = _mm256_movemask_ps(deposit);
+
+        for (int lane = 0; lane < DROPLET_PACKET_SIZE; lane++) {
+            if (!(aliveBits & (1 << lane)))
+                continue;
+
+            if (depositBits & (1 << lane)) {
                 // Add the sediment to the four nodes of the current cell using bilinear interpolation
-                float cellOffsetX = posX - nodeX;
-                float cellOffsetY = posY - nodeY;
-                heightMap[dropletIndex] += amountToDeposit * (1 - cellOffsetX) * (1 - cellOffsetY);
-                heightMap[dropletIndex + 1] += amountToDeposit * cellOffsetX * (1 - cellOffsetY);
-                heightMap[dropletIndex + width] += amountToDeposit * (1 - cellOffsetX) * cellOffsetY;
-                heightMap[dropletIndex + width + 1] += amountToDeposit * cellOffsetX * cellOffsetY;
+                float amount = laneDeposit[lane];
+                float cellOffsetX = lanePosX[lane] - laneNodeX[lane];
+                float cellOffsetY = lanePosY[lane] - laneNodeY[lane];
+                int dropletIndex = laneNodeY[lane] * width + laneNodeX[lane];
+                laneSediment[lane] -= amount;
+                heightMap[dropletIndex] += amount * (1 - cellOffsetX) * (1 - cellOffsetY);
+                heightMap[dropletIndex + 1] += amount * cellOffsetX * (1 - cellOffsetY);
+                heightMap[dropletIndex + width] += amount * (1 - cellOffsetX) * cellOffsetY;
+                heightMap[dropletIndex + width + 1] += amount * cellOffsetX * cellOffsetY;
             } else {
-                // Erode the terrain
-                float amountToErode = fminf((sedimentCapacity - sediment) * ERODE_SPEED, -deltaHeight);
-                int maxPoints = (2 * EROSION_RADIUS + 1) * (2 * EROSION_RADIUS + 1);
-
-                for (int brushPointIndex = 0; brushPointIndex < maxPoints; brushPointIndex++) {
-                    int nodeIndex = brush->indices[dropletIndex][brushPointIndex];
-                    float weighedErodeAmount = amountToErode * brush->weights[dropletIndex][brushPointIndex];
-                    float deltaSediment = fminf(heightMap[nodeIndex], weighedErodeAmount);
-                    heightMap[nodeIndex] -= deltaSediment;
-                    heightMap[nodeIndex] = fmaxf(heightMap[nodeIndex], 0);
-                    sediment += deltaSediment;
-                }
+                laneSediment[lane] += applyErosionBrush(heightMap, brush, laneNodeX[lane], laneNodeY[lane], laneErode[lane]);
             }
+        }
 
-            // Update droplet's speed and water content
-            speed = sqrtf(speed * speed + deltaHeight * GRAVITY);
-            water *= (1 - EVAPORATE_SPEED);
+        sediment = _mm256_loadu_ps(laneSediment);
+
+        // Update droplets' speed and water content
+        speed = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(speed, speed), _mm256_mul_ps(deltaHeight, _mm256_set1_ps(GRAVITY))));
+        water = _mm256_mul_ps(water, _mm256_set1_ps(1 - EVAPORATE_SPEED));
+    }
+}
+
+// Counter-based random number: the same (seed, stream, counter) always gives the same value
+static unsigned int hashDroplet(unsigned int seed, unsigned int stream, unsigned int counter) {
+    unsigned int h = seed ^ (stream * 0x9E3779B9u) ^ (counter * 0x85EBCA6Bu);
+    h ^= h >> 16;
+    h *= 0x7FEB352Du;
+    h ^= h >> 15;
+    h *= 0x846CA68Bu;
+    h ^= h >> 16;
+    return h;
+}
+
+// Erodes one tile of the current slice, job indices enumerate the phase's tiles row by row
+static void erodeTile(void* context, int jobIndex) {
+    ErosionProgress* job = (ErosionProgress*)context;
+
+    int phaseTilesX = (job->tilesX - (job->phase & 1) + 1) / 2;
+    int tileX = (jobIndex % phaseTilesX) * 2 + (job->phase & 1);
+    int tileY = (jobIndex / phaseTilesX) * 2 + (job->phase >> 1);
+    int tileIndex = tileY * job->tilesX + tileX;
+
+    int x0 = tileX * EROSION_TILE_SIZE;
+    int y0 = tileY * EROSION_TILE_SIZE;
+    int x1 = x0 + EROSION_TILE_SIZE < job->width ? x0 + EROSION_TILE_SIZE : job->width;
+    int y1 = y0 + EROSION_TILE_SIZE < job->height ? y0 + EROSION_TILE_SIZE : job->height;
+
+    int bounds[4] = {
+        x0 - EROSION_TILE_MARGIN > 0 ? x0 - EROSION_TILE_MARGIN : 0,
+        y0 - EROSION_TILE_MARGIN > 0 ? y0 - EROSION_TILE_MARGIN : 0,
+        x1 + EROSION_TILE_MARGIN < job->width - 1 ? x1 + EROSION_TILE_MARGIN : job->width - 1,
+        y1 + EROSION_TILE_MARGIN < job->height - 1 ? y1 + EROSION_TILE_MARGIN : job->height - 1,
+    };
+
+    // Droplets are spread over tiles by area
+    long long area = (long long)(x1 - x0) * (y1 - y0);
+
+    // Droplets sample the cell to their south east, so none may start on the last row or column
+    int spawnWidth = (x1 < job->width - 1 ? x1 : job->width - 1) - x0;
+    int spawnHeight = (y1 < job->height - 1 ? y1 : job->height - 1) - y0;
+    if (spawnWidth <= 0 || spawnHeight <= 0)
+        return;
+    int droplets = (int)(job->dropletCount * area / ((long long)job->width * job->height));
+    if (droplets > job->firstDroplet + EROSION_SLICE_DROPLETS)
+        droplets = job->firstDroplet + EROSION_SLICE_DROPLETS;
+
+    if (job->useSimd) {
+        for (int i = job->firstDroplet; i < droplets; i += DROPLET_PACKET_SIZE) {
+            float startX[DROPLET_PACKET_SIZE] = { 0 };
+            float startY[DROPLET_PACKET_SIZE] = { 0 };
+            int count = droplets - i < DROPLET_PACKET_SIZE ? droplets - i : DROPLET_PACKET_SIZE;
+
+            for (int lane = 0; lane < count; lane++) {
+                startX[lane] = (float)(x0 + hashDroplet(job->seed, tileIndex, (i + lane) * 2) % spawnWidth);
+                startY[lane] = (float)(y0 + hashDroplet(job->seed, tileIndex, (i + lane) * 2 + 1) % spawnHeight);
+            }
+
+            simulateDropletPacket(job->heightMap, job->width, job->brush, startX, startY, count, bounds);
         }
+        return;
+    }
+
+    for (int i = job->firstDroplet; i < droplets; i++) {
+        float posX = (float)(x0 + hashDroplet(job->seed, tileIndex, i * 2) % spawnWidth);
+        float posY = (float)(y0 + hashDroplet(job->seed, tileIndex, i * 2 + 1) % spawnHeight);
+        simulateDroplet(job->heightMap, job->width, job->height, job->brush, posX, posY, bounds);
     }
+}
+
+void beginErosion(ErosionProgress* erosion, float* heightMap, int width, int height, TerrainBrush* brush, unsigned int seed, int dropletCount, bool useSimd, ThreadPool* pool) {
+    erosion->heightMap = heightMap;
+    erosion->width = width;
+    erosion->height = height;
+    erosion->brush = brush;
+    erosion->seed = seed;
+    erosion->dropletCount = dropletCount;
+    erosion->useSimd = useSimd && cpuHasAvx2();
+    erosion->pool = pool;
+    erosion->tilesX = (width + EROSION_TILE_SIZE - 1) / EROSION_TILE_SIZE;
+    erosion->tilesY = (height + EROSION_TILE_SIZE - 1) / EROSION_TILE_SIZE;
+    erosion->phase = 0;
+    erosion->firstDroplet = 0;
+}
+
+bool isErosionFinished(ErosionProgress* erosion) {
+    return erosion->phase == 4;
+}
+
+// Runs slices until timeBudget milliseconds have passed, at least one slice per call.
+// A timeBudget of 0 runs every remaining slice. Tiles of a phase never overlap and every
+// tile runs its droplets in order, so eroding in slices gives the same result as eroding
+// each phase at once.
+bool stepErosion(ErosionProgress* erosion, long timeBudget) {
+    long start = getTime();
+
+    // Droplets of a full size tile, tiles on the bottom and right edges get fewer
+    int tileDroplets = (int)((long long)erosion->dropletCount * EROSION_TILE_SIZE * EROSION_TILE_SIZE / ((long long)erosion->width * erosion->height));
+
+    while (!isErosionFinished(erosion)) {
+        // Phases 2 and 3 start on the second tile row, which a single row map doesn't have
+        int phaseTilesX = (erosion->tilesX - (erosion->phase & 1) + 1) / 2;
+        int phaseTilesY = (erosion->tilesY - (erosion->phase >> 1) + 1) / 2;
+
+        if (phaseTilesX > 0 && phaseTilesY > 0) {
+            runJobs(erosion->pool, erodeTile, erosion, phaseTilesX * phaseTilesY);
+            erosion->firstDroplet += EROSION_SLICE_DROPLETS;
+        }
+
+        // Move on once every tile of the phase ran all its droplets
+        if (phaseTilesX <= 0 || phaseTilesY <= 0 || erosion->firstDroplet >= tileDroplets) {
+            erosion->firstDroplet = 0;
+            erosion->phase++;
+        }
+
+        if (timeBudget != 0 && getTime() - start >= timeBudget)
+            break;
+    }
+
+    return isErosionFinished(erosion);
+}
+
+// Parallel erosion, the result only depends on the seed and not on the number of threads.
+// useSimd selects the AVX2 packet kernel when the CPU supports it, which gives a
+// different (but equally deterministic) result than the scalar kernel.
+float* erodeHeightMapParallel(float* heightMap, int width, int height, TerrainBrush* brush, unsigned int seed, int dropletCount, bool useSimd, ThreadPool* pool) {
+    ErosionProgress erosion;
+    beginErosion(&erosion, heightMap, width, height, brush, seed, dropletCount, useSimd, pool);
+
+    stepErosion(&erosion, 0);
 
     return heightMap;
 }
@@ -156,42 +594,94 @@ HeightAndGradient calculateHeightAndGradient(float* heightMap, int width, int he
     return result;
 }
 
+// Removes up to amountToErode from the cells around the centre, returns the sediment picked up
+static float applyErosionBrush(float* heightMap, TerrainBrush* brush, int centreX, int centreY, float amountToErode) {
+    float sediment = 0.0f;
+    int centreIndex = centreY * brush->width + centreX;
+
+    // Interior cells use the precomputed stencil as is
+    if (centreX >= brush->radius && centreX < brush->width - brush->radius &&
+        centreY >= brush->radius && centreY < brush->height - brush->radius) {
+        for (int i = 0; i < brush->pointCount; i++) {
+            int nodeIndex = centreIndex + brush->indexOffsets[i];
+            float weighedErodeAmount = amountToErode * brush->weights[i];
+            float deltaSediment = fminf(heightMap[nodeIndex], weighedErodeAmount);
+            heightMap[nodeIndex] -= deltaSediment;
+            heightMap[nodeIndex] = fmaxf(heightMap[nodeIndex], 0);
+            sediment += deltaSediment;
+        }
+        return sediment;
+    }
+
+    // Border band: clip the stencil to the map and renormalize over the remaining points
+    float weightSum = 0.0f;
+    for (int i = 0; i < brush->pointCount; i++) {
+        int coordX = centreX + brush->offsetsX[i];
+        int coordY = centreY + brush->offsetsY[i];
+        if (coordX >= 0 && coordX < brush->width && coordY >= 0 && coordY < brush->height)
+            weightSum += brush->weights[i];
+    }
+
+    for (int i = 0; i < brush->pointCount; i++) {
+        int coordX = centreX + brush->offsetsX[i];
+        int coordY = centreY + brush->offsetsY[i];
+        if (coordX < 0 || coordX >= brush->width || coordY < 0 || coordY >= brush->height)
+            continue;
+
+        int nodeIndex = coordY * brush->width + coordX;
+        float weighedErodeAmount = amountToErode * brush->weights[i] / weightSum;
+        float deltaSediment = fminf(heightMap[nodeIndex], weighedErodeAmount);
+        heightMap[nodeIndex] -= deltaSediment;
+        heightMap[nodeIndex] = fmaxf(heightMap[nodeIndex], 0);
+        sediment += deltaSediment;
+    }
+
+    return sediment;
+}
+
 TerrainBrush* createTerrainBrush(int width, int height) {
     TerrainBrush* brush = (TerrainBrush*)malloc(sizeof(TerrainBrush));
-
-    brush->indices = (int**)malloc(width * height * sizeof(int*));
-    brush->weights = (float**)malloc(width * height * sizeof(float*));
     brush->radius = EROSION_RADIUS;
+    brush->width = width;
+    brush->height = height;
 
     const int maxPoints = (2 * brush->radius + 1) * (2 * brush->radius + 1);
-
-    for (int i = 0; i < width * height; i++) {
-        brush->indices[i] = (int*)calloc(maxPoints, sizeof(int));
-        brush->weights[i] = (float*)calloc(maxPoints, sizeof(float));
-
-        // Initialize the brush indices and weights
-        int centreX = i % width;
-        int centreY = i / width;
-        int addIndex = 0;
-
-        for (int y = -brush->radius; y <= brush->radius; y++) {
-            for (int x = -brush->radius; x <= brush->radius; x++) {
-                float sqrDst = x * x + y * y;
-                if (sqrDst < brush->radius * brush->radius) {
-                    int coordX = centreX + x;
-                    int coordY = centreY + y;
-
-                    if (coordX >= 0 && coordX < width && coordY >= 0 && coordY < height) {
-                        float weight = 1 - sqrtf(sqrDst) / brush->radius;
-                        brush->indices[i][addIndex] = coordY * width + coordX;
-                        brush->weights[i][addIndex] = weight;
-                    }
-                }
-
+    brush->offsetsX = (int*)malloc(maxPoints * sizeof(int));
+    brush->offsetsY = (int*)malloc(maxPoints * sizeof(int));
+    brush->indexOffsets = (int*)malloc(maxPoints * sizeof(int));
+    brush->weights = (float*)malloc(maxPoints * sizeof(float));
+
+    // Keep only the points inside the circle, weighted by distance from the centre
+    int addIndex = 0;
+    float weightSum = 0.0f;
+
+    for (int y = -brush->radius; y <= brush->radius; y++) {
+        for (int x = -brush->radius; x <= brush->radius; x++) {
+            float sqrDst = x * x + y * y;
+            if (sqrDst < brush->radius * brush->radius) {
+                float weight = 1 - sqrtf(sqrDst) / brush->radius;
+                brush->offsetsX[addIndex] = x;
+                brush->offsetsY[addIndex] = y;
+                brush->indexOffsets[addIndex] = y * width + x;
+                brush->weights[addIndex] = weight;
+                weightSum += weight;
                 addIndex++;
             }
         }
     }
-    
+
+    brush->pointCount = addIndex;
+
+    for (int i = 0; i < brush->pointCount; i++)
+        brush->weights[i] /= weightSum;
+
     return brush;
 }
+
+void cleanTerrainBrush(TerrainBrush* brush) {
+    free(brush->offsetsX);
+    free(brush->offsetsY);
+    free(brush->indexOffsets);
+    free(brush->weights);
+    free(brush);
+}
@@ -1,13 +1,48 @@
 #pragma once
 
 #include <GL/glew.h>
+#include <stdbool.h>
 
+#include "noise.h"
+#include "noisegraph.h"
+#include "thread.h"
+
+// Circular erosion kernel shared by every cell of the heightmap
 typedef struct {
-	int** indices;
-	float** weights;
 	int radius;
+	int width;
+	int height;
+	int pointCount;
+	int* offsetsX;     // Stencil offsets relative to the centre cell
+	int* offsetsY;
+	int* indexOffsets; // offsetY * width + offsetX, valid for cells at least radius away from the border
+	float* weights;    // Normalized so the full stencil sums to 1
 } TerrainBrush;
 
-float* generateHeightMap(int width, int length, float heightAmplifier, long seed, float frequency, int depth, int* offset);
+// Droplet erosion that can be spread over several calls, a slice runs a batch of droplets in
+// every tile of one checkerboard phase. Create with beginErosion and advance with stepErosion.
+typedef struct {
+	float* heightMap;
+	int width;
+	int height;
+	TerrainBrush* brush;
+	unsigned int seed;
+	int dropletCount;
+	bool useSimd;
+	ThreadPool* pool;
+	int tilesX;
+	int tilesY;
+	int phase;        // 4 once every phase has run
+	int firstDroplet; // First droplet of every tile in the next slice
+} ErosionProgress;
+
+float* generateHeightMap(int width, int length, float heightAmplifier, const NoiseGraph* graph, int* offset, int lod);
+float* generateHeightMapParallel(int width, int length, float heightAmplifier, const NoiseGraph* graph, int* offset, int lod, ThreadPool* pool);
+float* generateHeightMapNormals(int width, int length, float heightAmplifier, const Noise* noise, float frequency, int depth, int* offset, int lod, float* normals, ThreadPool* pool);
 float* erodeHeightMap(float* heightMap, int width, int height, TerrainBrush* brush);
-TerrainBrush* createTerrainBrush(int width, int height);
\ No newline at end of file
+float* erodeHeightMapParallel(float* heightMap, int width, int height, TerrainBrush* brush, unsigned int seed, int dropletCount, bool useSimd, ThreadPool* pool);
+void beginErosion(ErosionProgress* erosion, float* heightMap, int width, int height, TerrainBrush* brush, unsigned int seed, int dropletCount, bool useSimd, ThreadPool* pool);
+bool stepErosion(ErosionProgress* erosion, long timeBudget);
+bool isErosionFinished(ErosionProgress* erosion);
+TerrainBrush* createTerrainBrush(int width, int height);
+void cleanTerrainBrush(TerrainBrush* brush);
\ No newline at end of file
@@ -0,0 +1,238 @@
+#include "text.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ft2build.h>
+#include <freetype/freetype.h>
+
+#define ATLAS_WIDTH 512
+#define GLYPH_PADDING 1 // Empty texels between glyphs so linear filtering doesn't bleed
+
+Font* createFont(const char* fontPath, int pixelSize)
+{
+    FT_Library ft;
+    if (FT_Init_FreeType(&ft)) {
+        fprintf(stderr, "Could not init FreeType Library\n");
+        return NULL;
+    }
+
+    FT_Face face;
+    if (FT_New_Face(ft, fontPath, 0, &face)) {
+        fprintf(stderr, "Failed to load font\n");
+        FT_Done_FreeType(ft);
+        return NULL;
+    }
+
+    FT_Set_Pixel_Sizes(face, 0, pixelSize);
+
+    Font* font = (Font*)malloc(sizeof(Font));
+    memset(font->glyphs, 0, sizeof(font->glyphs));
+
+    // FreeType reuses the glyph slot, so keep a copy of every bitmap until the atlas is packed
+    unsigned char* bitmaps[128] = { 0 };
+    int positions[128][2] = { 0 }; // Glyphs that fail to load keep an empty quad at the atlas origin
+
+    // Pack glyphs into shelves, a new shelf starts when the current row is full
+    int penX = GLYPH_PADDING;
+    int penY = GLYPH_PADDING;
+    int shelfHeight = 0;
+
+    for (int c = 0; c < 128; c++) {
+        if (FT_Load_Char(face, c, FT_LOAD_RENDER)) {
+            fprintf(stderr, "Failed to load Glyph\n");
+            continue;
+        }
+
+        FT_Bitmap* bitmap = &face->glyph->bitmap;
+        int width = bitmap->width;
+        int rows = bitmap->rows;
+
+        if (penX + width + GLYPH_PADDING > ATLAS_WIDTH) {
+            penX = GLYPH_PADDING;
+            penY += shelfHeight + GLYPH_PADDING;
+            shelfHeight = 0;
+        }
+
+        positions[c][0] = penX;
+        positions[c][1] = penY;
+
+        if (width > 0 && rows > 0) {
+            bitmaps[c] = (unsigned char*)malloc(width * rows);
+            for (int row = 0; row < rows; row++)
+                memcpy(bitmaps[c] + row * width, bitmap->buffer + row * bitmap->pitch, width);
+        }
+
+        font->glyphs[c].size[0] = width;
+        font->glyphs[c].size[1] = rows;
+        font->glyphs[c].bearing[0] = face->glyph->bitmap_left;
+        font->glyphs[c].bearing[1] = face->glyph->bitmap_top;
+        font->glyphs[c].advance = face->glyph->advance.x >> 6; // Advance is in 1/64 pixels
+
+        penX += width + GLYPH_PADDING;
+        if (rows > shelfHeight)
+            shelfHeight = rows;
+    }
+
+    FT_Done_Face(face);
+    FT_Done_FreeType(ft);
+
+    font->atlasSize[0] = ATLAS_WIDTH;
+    font->atlasSize[1] = penY + shelfHeight + GLYPH_PADDING;
+
+    // Blit every glyph into the atlas and compute its texture coordinates
+    unsigned char* atlas = (unsigned char*)calloc(font->atlasSize[0] * font->atlasSize[1], 1);
+
+    for (int c = 0; c < 128; c++) {
+        Glyph* glyph = &font->glyphs[c];
+
+        if (bitmaps[c] != NULL) {
+            for (int row = 0; row < glyph->size[1]; row++)
+                memcpy(atlas + (positions[c][1] + row) * font->atlasSize[0] + positions[c][0], bitmaps[c] + row * glyph->size[0], glyph->size[0]);
+            free(bitmaps[c]);
+        }
+
+        glyph->uv[0] = (float)positions[c][0] / font->atlasSize[0];
+        glyph->uv[1] = (float)positions[c][1] / font->atlasSize[1];
+        glyph->uv[2] = (float)(positions[c][0] + glyph->size[0]) / font->atlasSize[0];
+        glyph->uv[3] = (float)(positions[c][1] + glyph->size[1]) / font->atlasSize[1];
+    }
+
+    glGenTextures(1, &font->texture);
+    glBindTexture(GL_TEXTURE_2D, font->texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, font->atlasSize[0], font->atlasSize[1], 0, GL_RED, GL_UNSIGNED_BYTE, atlas);
+
+    // Set texture options
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    free(atlas);
+
+    return font;
+}
+
+void cleanFont(Font* font)
+{
+    glDeleteTextures(1, &font->texture);
+    free(font);
+}
+
+TextBatch* createTextBatch(Font* font, Shader* shader, int screenWidth, int screenHeight)
+{
+    TextBatch* batch = (TextBatch*)malloc(sizeof(TextBatch));
+    batch->shader = shader;
+    batch->font = font;
+    batch->screenSize[0] = screenWidth;
+    batch->screenSize[1] = screenHeight;
+    batch->quadCount = 0;
+    batch->quadCapacity = 64;
+    batch->bufferCapacity = batch->quadCapacity;
+    batch->vertices = (GLfloat*)malloc(batch->quadCapacity * 6 * 4 * sizeof(GLfloat));
+
+    glGenVertexArrays(1, &batch->vao);
+    glBindVertexArray(batch->vao);
+
+    glGenBuffers(1, &batch->vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, batch->vbo);
+    glBufferData(GL_ARRAY_BUFFER, batch->bufferCapacity * 6 * 4 * sizeof(GLfloat), NULL, GL_DYNAMIC_DRAW);
+
+    GLint vertexAttribute = shader->attributes[ATTRIBUTE_VERTEX];
+    if (vertexAttribute != -1) {
+        glVertexAttribPointer(vertexAttribute, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), 0);
+        glEnableVertexAttribArray(vertexAttribute);
+    }
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    return batch;
+}
+
+// Appends the quads of a string, nothing reaches the GPU until renderText
+void addText(TextBatch* batch, const char* text, float x, float y, float scale)
+{
+    int length = (int)strlen(text);
+    if (batch->quadCount + length > batch->quadCapacity) {
+        while (batch->quadCount + length > batch->quadCapacity)
+            batch->quadCapacity *= 2;
+        batch->vertices = (GLfloat*)realloc(batch->vertices, batch->quadCapacity * 6 * 4 * sizeof(GLfloat));
+    }
+
+    for (const char* c = text; *c; c++)
+    {
+        Glyph* glyph = &batch->font->glyphs[(unsigned char)*c & 127];
+
+        float xpos = x + glyph->bearing[0] * scale;
+        float ypos = y - (glyph->size[1] - glyph->bearing[1]) * scale;
+
+        float w = glyph->size[0] * scale;
+        float h = glyph->size[1] * scale;
+
+        x += glyph->advance * scale;
+
+        // Whitespace has no bitmap, only an advance
+        if (glyph->size[0] == 0 || glyph->size[1] == 0)
+            continue;
+
+        float xposScaled = xpos / batch->screenSize[0] * 2.0f - 1.0f;
+        float xposWScaled = (xpos + w) / batch->screenSize[0] * 2.0f - 1.0f;
+
+        float yposScaled = ypos / batch->screenSize[1] * 2.0f - 1.0f;
+        float yposHScaled = (ypos + h) / batch->screenSize[1] * 2.0f - 1.0f;
+
+        float u0 = glyph->uv[0], v0 = glyph->uv[1];
+        float u1 = glyph->uv[2], v1 = glyph->uv[3];
+
+        float vertices[6][4] = {
+            { xposScaled, yposHScaled, u0, v0 },
+            { xposScaled, yposScaled, u0, v1 },
+            { xposWScaled, yposScaled, u1, v1 },
+
+            { xposScaled,  yposHScaled, u0, v0 },
+            { xposWScaled, yposScaled, u1, v1 },
+            { xposWScaled, yposHScaled, u1, v0 }
+        };
+
+        memcpy(batch->vertices + batch->quadCount * 6 * 4, vertices, sizeof(vertices));
+        batch->quadCount++;
+    }
+}
+
+// Uploads every quad added this frame and draws them with a single call
+void renderText(TextBatch* batch)
+{
+    if (batch->quadCount == 0)
+        return;
+
+    glBindBuffer(GL_ARRAY_BUFFER, batch->vbo);
+
+    // Orphan the old storage so the driver doesn't stall on last frame's draw
+    if (batch->quadCount > batch->bufferCapacity)
+        batch->bufferCapacity = batch->quadCapacity;
+    glBufferData(GL_ARRAY_BUFFER, batch->bufferCapacity * 6 * 4 * sizeof(GLfloat), NULL, GL_DYNAMIC_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, batch->quadCount * 6 * 4 * sizeof(GLfloat), batch->vertices);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glUseProgram(batch->shader->program);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, batch->font->texture);
+    glBindVertexArray(batch->vao);
+
+    glDrawArrays(GL_TRIANGLES, 0, batch->quadCount * 6);
+
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    batch->quadCount = 0;
+}
+
+void cleanTextBatch(TextBatch* batch)
+{
+    glDeleteBuffers(1, &batch->vbo);
+    glDeleteVertexArrays(1, &batch->vao);
+    free(batch->vertices);
+    free(batch);
+}
\ No newline at end of file
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include "shader.h"
+
+typedef struct {
+	int size[2];    // Size of glyph in pixels
+	int bearing[2]; // Offset from baseline to left/top of glyph
+	int advance;    // Horizontal offset to advance to next glyph in pixels
+	float uv[4];    // Top-left and bottom-right corner of the glyph inside the atlas
+} Glyph;
+
+typedef struct {
+	GLuint texture; // Single atlas holding every glyph
+	int atlasSize[2];
+	Glyph glyphs[128];
+} Font;
+
+typedef struct {
+	GLuint vao;
+	GLuint vbo;
+	Shader* shader;
+	Font* font;
+	int screenSize[2];
+	GLfloat* vertices; // 6 vertices of 4 floats per quad, rebuilt every frame
+	int quadCount;
+	int quadCapacity;  // Quads that fit into vertices
+	int bufferCapacity; // Quads that fit into vbo
+} TextBatch;
+
+Font* createFont(const char* fontPath, int pixelSize);
+void cleanFont(Font* font);
+TextBatch* createTextBatch(Font* font, Shader* shader, int screenWidth, int screenHeight);
+void addText(TextBatch* batch, const char* text, float x, float y, float scale);
+void renderText(TextBatch* batch);
+void cleanTextBatch(TextBatch* batch);
\ No newline at end of file
@@ -0,0 +1,155 @@
+#include "thermal.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <emmintrin.h>
+
+// Thermal weathering: material slides off every slope steeper than the talus angle
+// until the height difference to each of the 8 neighbours falls back under it.
+
+// Simulation Parameters
+#define THERMAL_TALUS 1.0f            // Largest stable height difference between two adjacent cells
+#define THERMAL_DIAGONAL_TALUS 1.41421356f
+#define THERMAL_RATE 0.05f            // Fraction of the excess moved per iteration, at most 1/16 to stay stable
+
+// Rows handed to a worker at a time
+#define THERMAL_BAND_ROWS 16
+
+typedef struct {
+    int width;
+    int height;
+    int stride;       // width + 2, the padding ring repeats the edge cells so nothing flows out
+    float* terrain;
+    float* nextTerrain;
+} ThermalGrid;
+
+// Material exchanged with one neighbour, positive when it flows out of the cell.
+// The same amount is computed from the other side with the opposite sign, so mass is conserved.
+static inline float talusFlow(float difference, float talus)
+{
+    float clamped = difference < -talus ? -talus : (difference > talus ? talus : difference);
+    return (difference - clamped) * THERMAL_RATE;
+}
+
+static inline __m128 talusFlowPs(__m128 difference, __m128 talus, __m128 negativeTalus)
+{
+    __m128 clamped = _mm_min_ps(_mm_max_ps(difference, negativeTalus), talus);
+    return _mm_mul_ps(_mm_sub_ps(difference, clamped), _mm_set1_ps(THERMAL_RATE));
+}
+
+static inline void weatherCell(ThermalGrid* grid, int i)
+{
+    const int stride = grid->stride;
+    const float* terrain = grid->terrain;
+    float own = terrain[i];
+
+    float outflow = talusFlow(own - terrain[i - 1], THERMAL_TALUS)
+        + talusFlow(own - terrain[i + 1], THERMAL_TALUS)
+        + talusFlow(own - terrain[i - stride], THERMAL_TALUS)
+        + talusFlow(own - terrain[i + stride], THERMAL_TALUS)
+        + talusFlow(own - terrain[i - stride - 1], THERMAL_DIAGONAL_TALUS)
+        + talusFlow(own - terrain[i - stride + 1], THERMAL_DIAGONAL_TALUS)
+        + talusFlow(own - terrain[i + stride - 1], THERMAL_DIAGONAL_TALUS)
+        + talusFlow(own - terrain[i + stride + 1], THERMAL_DIAGONAL_TALUS);
+
+    grid->nextTerrain[i] = own - outflow;
+}
+
+// Rows are processed 4 cells at a time with SSE, the scalar cell handles the remainder
+static void weatherRow(ThermalGrid* grid, int y)
+{
+    const int stride = grid->stride;
+    const float* terrain = grid->terrain;
+
+    const __m128 talus = _mm_set1_ps(THERMAL_TALUS);
+    const __m128 negativeTalus = _mm_set1_ps(-THERMAL_TALUS);
+    const __m128 diagonalTalus = _mm_set1_ps(THERMAL_DIAGONAL_TALUS);
+    const __m128 negativeDiagonalTalus = _mm_set1_ps(-THERMAL_DIAGONAL_TALUS);
+
+    int i = (y + 1) * stride + 1;
+    const int end = i + grid->width;
+
+    for (; i + 4 <= end; i += 4) {
+        __m128 own = _mm_loadu_ps(terrain + i);
+
+        __m128 cardinal = _mm_add_ps(
+            _mm_add_ps(talusFlowPs(_mm_sub_ps(own, _mm_loadu_ps(terrain + i - 1)), talus, negativeTalus),
+                talusFlowPs(_mm_sub_ps(own, _mm_loadu_ps(terrain + i + 1)), talus, negativeTalus)),
+            _mm_add_ps(talusFlowPs(_mm_sub_ps(own, _mm_loadu_ps(terrain + i - stride)), talus, negativeTalus),
+                talusFlowPs(_mm_sub_ps(own, _mm_loadu_ps(terrain + i + stride)), talus, negativeTalus)));
+
+        __m128 diagonal = _mm_add_ps(
+            _mm_add_ps(talusFlowPs(_mm_sub_ps(own, _mm_loadu_ps(terrain + i - stride - 1)), diagonalTalus, negativeDiagonalTalus),
+                talusFlowPs(_mm_sub_ps(own, _mm_loadu_ps(terrain + i - stride + 1)), diagonalTalus, negativeDiagonalTalus)),
+            _mm_add_ps(talusFlowPs(_mm_sub_ps(own, _mm_loadu_ps(terrain + i + stride - 1)), diagonalTalus, negativeDiagonalTalus),
+                talusFlowPs(_mm_sub_ps(own, _mm_loadu_ps(terrain + i + stride + 1)), diagonalTalus, negativeDiagonalTalus)));
+
+        _mm_storeu_ps(grid->nextTerrain + i, _mm_sub_ps(own, _mm_add_ps(cardinal, diagonal)));
+    }
+
+    for (; i < end; i++)
+        weatherCell(grid, i);
+}
+
+static void weatherBand(void* context, int band)
+{
+    ThermalGrid* grid = (ThermalGrid*)context;
+    int firstRow = band * THERMAL_BAND_ROWS;
+    int lastRow = firstRow + THERMAL_BAND_ROWS < grid->height ? firstRow + THERMAL_BAND_ROWS : grid->height;
+
+    for (int y = firstRow; y < lastRow; y++)
+        weatherRow(grid, y);
+}
+
+// Copies the edge cells into the padding ring, a flat border means no flow across it
+static void updatePadding(ThermalGrid* grid)
+{
+    const int stride = grid->stride;
+    float* terrain = grid->terrain;
+
+    for (int y = 1; y <= grid->height; y++) {
+        terrain[y * stride] = terrain[y * stride + 1];
+        terrain[y * stride + grid->width + 1] = terrain[y * stride + grid->width];
+    }
+
+    memcpy(terrain, terrain + stride, stride * sizeof(float));
+    memcpy(terrain + (grid->height + 1) * stride, terrain + grid->height * stride, stride * sizeof(float));
+}
+
+// Relaxes slopes steeper than the talus angle, iterations bounds how far material can slide
+float* erodeHeightMapThermal(float* heightMap, int width, int height, int iterations, ThreadPool* pool)
+{
+    ThermalGrid grid;
+    grid.width = width;
+    grid.height = height;
+    grid.stride = width + 2;
+
+    size_t cellCount = (size_t)grid.stride * (height + 2);
+    float* buffers = (float*)malloc(cellCount * 2 * sizeof(float));
+    if (buffers == NULL)
+        return heightMap;
+
+    grid.terrain = buffers;
+    grid.nextTerrain = buffers + cellCount;
+
+    for (int y = 0; y < height; y++)
+        memcpy(grid.terrain + (y + 1) * grid.stride + 1, heightMap + y * width, width * sizeof(float));
+
+    int bands = (height + THERMAL_BAND_ROWS - 1) / THERMAL_BAND_ROWS;
+
+    for (int iteration = 0; iteration < iterations; iteration++) {
+        updatePadding(&grid);
+        runJobs(pool, weatherBand, &grid, bands);
+
+        float* swap = grid.terrain;
+        grid.terrain = grid.nextTerrain;
+        grid.nextTerrain = swap;
+    }
+
+    for (int y = 0; y < height; y++)
+        memcpy(heightMap + y * width, grid.terrain + (y + 1) * grid.stride + 1, width * sizeof(float));
+
+    free(buffers);
+
+    return heightMap;
+}
\ No newline at end of file
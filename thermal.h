@@ -0,0 +1,5 @@
+#pragma once
+
+#include "thread.h"
+
+float* erodeHeightMapThermal(float* heightMap, int width, int height, int iterations, ThreadPool* pool);
\ No newline at end of file
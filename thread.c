@@ -0,0 +1,294 @@
+#include "thread.h"
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#ifdef _WIN32
+#include <windows.h>
+
+typedef HANDLE ThreadHandle;
+typedef CRITICAL_SECTION Mutex;
+typedef CONDITION_VARIABLE Condition;
+
+#define THREAD_RESULT DWORD WINAPI
+
+static void initMutex(Mutex* mutex) { InitializeCriticalSection(mutex); }
+static void destroyMutex(Mutex* mutex) { DeleteCriticalSection(mutex); }
+static void lockMutex(Mutex* mutex) { EnterCriticalSection(mutex); }
+static void unlockMutex(Mutex* mutex) { LeaveCriticalSection(mutex); }
+static void initCondition(Condition* condition) { InitializeConditionVariable(condition); }
+static void destroyCondition(Condition* condition) { (void)condition; }
+static void waitCondition(Condition* condition, Mutex* mutex) { SleepConditionVariableCS(condition, mutex, INFINITE); }
+static void wakeAll(Condition* condition) { WakeAllConditionVariable(condition); }
+
+static bool startThread(ThreadHandle* thread, LPTHREAD_START_ROUTINE function, void* argument)
+{
+    *thread = CreateThread(NULL, 0, function, argument, 0, NULL);
+    return *thread != NULL;
+}
+
+static void joinThread(ThreadHandle thread)
+{
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+int getProcessorCount()
+{
+    SYSTEM_INFO systemInfo;
+    GetSystemInfo(&systemInfo);
+    return (int)systemInfo.dwNumberOfProcessors;
+}
+
+// Interlocked functions are full barriers
+long loadAtomic(volatile long* value) { return InterlockedCompareExchange(value, 0, 0); }
+void storeAtomic(volatile long* value, long newValue) { InterlockedExchange(value, newValue); }
+void* loadAtomicPointer(void* volatile* pointer) { return InterlockedCompareExchangePointer(pointer, NULL, NULL); }
+void* exchangeAtomicPointer(void* volatile* pointer, void* newValue) { return InterlockedExchangePointer(pointer, newValue); }
+#else
+#include <pthread.h>
+#include <unistd.h>
+
+typedef pthread_t ThreadHandle;
+typedef pthread_mutex_t Mutex;
+typedef pthread_cond_t Condition;
+
+#define THREAD_RESULT void*
+
+static void initMutex(Mutex* mutex) { pthread_mutex_init(mutex, NULL); }
+static void destroyMutex(Mutex* mutex) { pthread_mutex_destroy(mutex); }
+static void lockMutex(Mutex* mutex) { pthread_mutex_lock(mutex); }
+static void unlockMutex(Mutex* mutex) { pthread_mutex_unlock(mutex); }
+static void initCondition(Condition* condition) { pthread_cond_init(condition, NULL); }
+static void destroyCondition(Condition* condition) { pthread_cond_destroy(condition); }
+static void waitCondition(Condition* condition, Mutex* mutex) { pthread_cond_wait(condition, mutex); }
+static void wakeAll(Condition* condition) { pthread_cond_broadcast(condition); }
+
+static bool startThread(ThreadHandle* thread, void* (*function)(void*), void* argument)
+{
+    return pthread_create(thread, NULL, function, argument) == 0;
+}
+
+static void joinThread(ThreadHandle thread)
+{
+    pthread_join(thread, NULL);
+}
+
+int getProcessorCount()
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+}
+
+long loadAtomic(volatile long* value) { return __atomic_load_n(value, __ATOMIC_ACQUIRE); }
+void storeAtomic(volatile long* value, long newValue) { __atomic_store_n(value, newValue, __ATOMIC_RELEASE); }
+void* loadAtomicPointer(void* volatile* pointer) { return __atomic_load_n(pointer, __ATOMIC_ACQUIRE); }
+void* exchangeAtomicPointer(void* volatile* pointer, void* newValue) { return __atomic_exchange_n(pointer, newValue, __ATOMIC_ACQ_REL); }
+#endif
+
+struct ThreadPool {
+    int threadCount;     // Including the thread that calls runJobs
+    ThreadHandle* workers;
+    Mutex mutex;
+    Condition workReady;
+    Condition workDone;
+    JobFunction job;
+    void* context;
+    int jobCount;
+    int nextJob;
+    int pendingJobs;
+    int batch;           // Incremented for every runJobs call so sleeping workers notice new work
+    bool quit;
+};
+
+// Runs jobs of the current batch until none are left, expects the mutex to be held
+static void drainJobs(ThreadPool* pool)
+{
+    while (pool->nextJob < pool->jobCount) {
+        int jobIndex = pool->nextJob++;
+        JobFunction job = pool->job;
+        void* context = pool->context;
+
+        unlockMutex(&pool->mutex);
+        job(context, jobIndex);
+        lockMutex(&pool->mutex);
+
+        if (--pool->pendingJobs == 0)
+            wakeAll(&pool->workDone);
+    }
+}
+
+static THREAD_RESULT workerMain(void* argument)
+{
+    ThreadPool* pool = (ThreadPool*)argument;
+    int seenBatch = 0;
+
+    lockMutex(&pool->mutex);
+    while (true) {
+        while (!pool->quit && pool->batch == seenBatch)
+            waitCondition(&pool->workReady, &pool->mutex);
+
+        if (pool->quit)
+            break;
+
+        seenBatch = pool->batch;
+        drainJobs(pool);
+    }
+    unlockMutex(&pool->mutex);
+
+    return 0;
+}
+
+// A threadCount of 0 or less sizes the pool to the machine
+ThreadPool* createThreadPool(int threadCount)
+{
+    if (threadCount <= 0)
+        threadCount = getProcessorCount();
+
+    ThreadPool* pool = (ThreadPool*)malloc(sizeof(ThreadPool));
+    pool->threadCount = 1;
+    pool->workers = (ThreadHandle*)malloc(threadCount * sizeof(ThreadHandle));
+    pool->job = NULL;
+    pool->context = NULL;
+    pool->jobCount = 0;
+    pool->nextJob = 0;
+    pool->pendingJobs = 0;
+    pool->batch = 0;
+    pool->quit = false;
+
+    initMutex(&pool->mutex);
+    initCondition(&pool->workReady);
+    initCondition(&pool->workDone);
+
+    for (int i = 0; i < threadCount - 1; i++) {
+        if (!startThread(&pool->workers[i], workerMain, pool))
+            break;
+        pool->threadCount++;
+    }
+
+    return pool;
+}
+
+int getThreadPoolSize(ThreadPool* pool)
+{
+    return pool->threadCount;
+}
+
+// Runs job(context, i) for every i in [0, jobCount) and returns once all of them finished
+void runJobs(ThreadPool* pool, JobFunction job, void* context, int jobCount)
+{
+    if (jobCount <= 0)
+        return;
+
+    if (pool == NULL || pool->threadCount == 1 || jobCount == 1) {
+        for (int i = 0; i < jobCount; i++)
+            job(context, i);
+        return;
+    }
+
+    lockMutex(&pool->mutex);
+
+    pool->job = job;
+    pool->context = context;
+    pool->jobCount = jobCount;
+    pool->nextJob = 0;
+    pool->pendingJobs = jobCount;
+    pool->batch++;
+    wakeAll(&pool->workReady);
+
+    drainJobs(pool);
+
+    while (pool->pendingJobs > 0)
+        waitCondition(&pool->workDone, &pool->mutex);
+
+    unlockMutex(&pool->mutex);
+}
+
+void cleanThreadPool(ThreadPool* pool)
+{
+    lockMutex(&pool->mutex);
+    pool->quit = true;
+    wakeAll(&pool->workReady);
+    unlockMutex(&pool->mutex);
+
+    for (int i = 0; i < pool->threadCount - 1; i++)
+        joinThread(pool->workers[i]);
+
+    destroyCondition(&pool->workReady);
+    destroyCondition(&pool->workDone);
+    destroyMutex(&pool->mutex);
+    free(pool->workers);
+    free(pool);
+}
+
+struct Thread {
+    ThreadHandle handle;
+    ThreadFunction function;
+    void* argument;
+};
+
+static THREAD_RESULT threadMain(void* argument)
+{
+    Thread* thread = (Thread*)argument;
+    thread->function(thread->argument);
+    return 0;
+}
+
+Thread* createThread(ThreadFunction function, void* argument)
+{
+    Thread* thread = (Thread*)malloc(sizeof(Thread));
+    thread->function = function;
+    thread->argument = argument;
+
+    if (!startThread(&thread->handle, threadMain, thread)) {
+        free(thread);
+        return NULL;
+    }
+
+    return thread;
+}
+
+void cleanThread(Thread* thread)
+{
+    joinThread(thread->handle);
+    free(thread);
+}
+
+struct Signal {
+    Mutex mutex;
+    Condition condition;
+    bool raised;
+};
+
+Signal* createSignal()
+{
+    Signal* signal = (Signal*)malloc(sizeof(Signal));
+    initMutex(&signal->mutex);
+    initCondition(&signal->condition);
+    signal->raised = false;
+    return signal;
+}
+
+void raiseSignal(Signal* signal)
+{
+    lockMutex(&signal->mutex);
+    signal->raised = true;
+    wakeAll(&signal->condition);
+    unlockMutex(&signal->mutex);
+}
+
+void waitSignal(Signal* signal)
+{
+    lockMutex(&signal->mutex);
+    while (!signal->raised)
+        waitCondition(&signal->condition, &signal->mutex);
+    signal->raised = false;
+    unlockMutex(&signal->mutex);
+}
+
+void cleanSignal(Signal* signal)
+{
+    destroyCondition(&signal->condition);
+    destroyMutex(&signal->mutex);
+    free(signal);
+}
\ No newline at end of file
@@ -0,0 +1,35 @@
+#pragma once
+
+// Called once for every job index in [0, jobCount)
+typedef void (*JobFunction)(void* context, int jobIndex);
+
+// Fixed set of worker threads, the calling thread works alongside them.
+// runJobs is not reentrant, only one thread at a time may submit work to a pool.
+typedef struct ThreadPool ThreadPool;
+
+int getProcessorCount();
+ThreadPool* createThreadPool(int threadCount);
+int getThreadPoolSize(ThreadPool* pool);
+void runJobs(ThreadPool* pool, JobFunction job, void* context, int jobCount);
+void cleanThreadPool(ThreadPool* pool);
+
+// Atomic loads, stores and swaps with acquire/release ordering, for handing data between threads without locks
+long loadAtomic(volatile long* value);
+void storeAtomic(volatile long* value, long newValue);
+void* loadAtomicPointer(void* volatile* pointer);
+void* exchangeAtomicPointer(void* volatile* pointer, void* newValue);
+
+// Single background thread, cleanThread waits for the function to return
+typedef void (*ThreadFunction)(void* argument);
+typedef struct Thread Thread;
+
+Thread* createThread(ThreadFunction function, void* argument);
+void cleanThread(Thread* thread);
+
+// Auto-resetting flag a thread can sleep on, raising it twice before a wait wakes the waiter once
+typedef struct Signal Signal;
+
+Signal* createSignal();
+void raiseSignal(Signal* signal);
+void waitSignal(Signal* signal);
+void cleanSignal(Signal* signal);
\ No newline at end of file